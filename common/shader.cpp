@@ -13,7 +13,18 @@ using namespace std;
 
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// Inserts the defines after the #version line, which has to stay first.
+static void InsertDefines(std::string & Code, const char * defines){
+	if (!*defines)
+		return;
+	size_t Pos = Code.find("#version");
+	Pos = Pos == std::string::npos ? 0 : Code.find('\n', Pos);
+	if (Pos == std::string::npos)
+		Pos = Code.size();
+	Code.insert(Pos, std::string("\n") + defines);
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines){
 
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -43,6 +54,9 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		FragmentShaderStream.close();
 	}
 
+	InsertDefines(VertexShaderCode, defines);
+	InsertDefines(FragmentShaderCode, defines);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -3,6 +3,7 @@
 
 #include <GL/glew.h>
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+// Defines are inserted into both shaders right after their #version line.
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path, const char * defines = "");
 
 #endif
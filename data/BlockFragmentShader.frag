@@ -2,7 +2,7 @@
 
 // Interpolated values from the vertex shaders
 in vec2 UV;
-flat in float light;
+flat in ivec3 lightTexel;
 in float OS;
 
 // Ouput data
@@ -11,15 +11,60 @@ out vec4 color;
 
 // Values that stay constant for the whole mesh.
 uniform sampler2D myTextureSampler;
+// Light of every voxel, looked up at the voxel in front of the side.
+uniform sampler3D lightAtlas;
 
+#ifdef DYNAMIC_LIGHTS
+in vec3 worldPos;
+
+// See DynamicLights.h. Two texels per light: position and radius, color.
+uniform samplerBuffer dynamicLights;
+// Offset into lightIndices and light count of every cluster.
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+// Number of clusters per pixel.
+uniform vec2 clusterScale;
+
+vec3 dynamicLight() {
+    // Flat normal of the side, facing the camera.
+    vec3 normal = normalize(cross(dFdx(worldPos), dFdy(worldPos)));
+
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterScale), ivec2(0),
+                       ivec2(CLUSTERS_X - 1, CLUSTERS_Y - 1));
+    float w = 1.0 / gl_FragCoord.w;
+    int slice = clamp(int(log(max(w / SLICE_NEAR, 1.0)) * SLICE_SCALE), 0, CLUSTERS_Z - 1);
+    int cluster = tile.x + tile.y * CLUSTERS_X + slice * CLUSTERS_X * CLUSTERS_Y;
+    uvec2 range = texelFetch(lightClusters, cluster).rg;
+
+    vec3 sum = vec3(0);
+    for (uint i = 0u; i < range.y; ++i) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 posRadius = texelFetch(dynamicLights, light * 2);
+        vec3 toLight = posRadius.xyz - worldPos;
+        float distance = length(toLight);
+        float falloff = clamp(1.0 - distance / posRadius.w, 0.0, 1.0);
+        sum += texelFetch(dynamicLights, light * 2 + 1).rgb * falloff * falloff
+             * max(dot(normal, toLight / max(distance, 0.001)), 0.0);
+    }
+    return sum;
+}
+#endif
+
+// CUTOUT is defined for the pass that draws blocks with magenta keyed
+// texels. Without it there is no discard, so early depth testing stays on.
 void main(){
 
     vec3 texColor = texture(myTextureSampler, vec2(UV.x, -UV.y)).rgb;
+#ifdef CUTOUT
     if (texColor.r >= 0.99f && texColor.g <= 0.01f && texColor.b >= 0.99f) {
 	  discard;
-    } else {
-	  // Output color = color of the texture at the specified UV
-	  color.rgb = texture(myTextureSampler, vec2(UV.x, -UV.y)).rgb * OS * light;
-	  color.a = 1;
     }
-}
\ No newline at end of file
+#endif
+    vec3 light = vec3(texelFetch(lightAtlas, lightTexel, 0).r);
+#ifdef DYNAMIC_LIGHTS
+    light += dynamicLight();
+#endif
+    // Output color = color of the texture at the specified UV
+    color.rgb = texColor * OS * light;
+    color.a = 1;
+}
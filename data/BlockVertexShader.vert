@@ -3,13 +3,16 @@
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec2 vertexUV;
-layout(location = 2) in float vertexLight;
+layout(location = 2) in vec3 vertexLightTexel;
 layout(location = 3) in float vertexOS;
 
 // Output data ; will be interpolated for each fragment.
 out vec2 UV;
-flat out float light;
+flat out ivec3 lightTexel;
 out float OS;
+#ifdef DYNAMIC_LIGHTS
+out vec3 worldPos;
+#endif
 
 // Values that stay constant for the whole mesh.
 uniform mat4 MVP;
@@ -21,7 +24,10 @@ void main(){
 	
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
-	light = vertexLight;
+	lightTexel = ivec3(vertexLightTexel);
 	OS = vertexOS;
+#ifdef DYNAMIC_LIGHTS
+	worldPos = vertexPosition_modelspace;
+#endif
 }
 
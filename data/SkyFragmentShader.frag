@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec2 screenPos;
+
+// Ouput data
+out vec4 color;
+
+// Inverse of the projection times the rotation of the view, without its
+// translation, so it maps screen positions to directions.
+uniform mat4 inverseViewProjection;
+uniform samplerCube sky;
+
+void main(){
+	vec4 dir = inverseViewProjection * vec4(screenPos, 1, 1);
+	color = vec4(texture(sky, dir.xyz / dir.w).rgb, 1.0f);
+}
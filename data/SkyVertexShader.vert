@@ -0,0 +1,11 @@
+#version 330 core
+
+// Position on the screen in normalized device coordinates.
+out vec2 screenPos;
+
+void main(){
+	// One triangle covering the whole screen, lying on the far plane.
+	vec2 pos = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);
+	screenPos = pos;
+	gl_Position = vec4(pos, 1, 1);
+}
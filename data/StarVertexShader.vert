@@ -0,0 +1,37 @@
+#version 330 core
+
+// One instance per star.
+layout(location = 0) in vec4 starPositionSize;
+layout(location = 1) in vec4 starTileLight;
+
+// Output data ; will be interpolated for each fragment.
+out vec2 UV;
+out float Light;
+
+// Values that stay constant for the whole mesh.
+uniform mat4 MVP;
+
+// Corners of the two triangles of the billboard along its right and up
+// axis, and their offset inside the texture tile.
+const vec2 Corners[6] = vec2[6](vec2(1, 1), vec2(-1, 1), vec2(-1, -1),
+                                vec2(-1, -1), vec2(1, -1), vec2(1, 1));
+const vec2 CornerUVs[6] = vec2[6](vec2(0, 0), vec2(1, 0), vec2(1, 1),
+                                  vec2(1, 1), vec2(0, 1), vec2(0, 0));
+
+void main(){
+	vec3 center = starPositionSize.xyz;
+	vec3 dir = normalize(center);
+
+	// The billboard faces the origin, with its right axis kept horizontal.
+	vec3 right = vec3(dir.z, 0, -dir.x);
+	right = dot(right, right) > 1e-6 ? normalize(right) : vec3(1, 0, 0);
+	vec3 up = normalize(cross(right, dir));
+
+	vec2 corner = Corners[gl_VertexID];
+	vec3 pos = center + (right * corner.x + up * corner.y) * starPositionSize.w;
+	gl_Position = MVP * vec4(pos, 1);
+
+	// The texture has 2x2 tiles.
+	UV = (starTileLight.xy + CornerUVs[gl_VertexID]) * 0.5;
+	Light = starTileLight.z;
+}
@@ -4,161 +4,238 @@
 
 #include <vector>
 #include <string>
-#include "Texture.h"
+#include <array>
+#include <glm/glm.hpp>
+#include <cassert>
+#include "GeometryArena.h"
 
 class BlockSideArray {
+public:
+  // Sides are sorted into passes by how they have to be drawn. Cutout sides
+  // discard magenta texels in the fragment shader, which disables early depth
+  // testing, so they are kept away from the opaque ones.
+  enum Pass {
+    OPAQUE_PASS,
+    CUTOUT_PASS,
+    PASS_COUNT
+  };
+
+  // Sides are additionally sorted by the direction they face, using the
+  // voxel side numbering. A section can then skip all sides that face away
+  // from the camera without looking at a single triangle.
+  static const unsigned FACE_COUNT = 6;
+
+  // Every side is a quad of two triangles.
+  static const GLsizei QUAD_VERTICES = 6;
+
+private:
+  struct Bucket {
+    std::vector<GeometryArena::Vertex> vertices;
+
+    // Only used after finalize(). Number of quads there is room for in the
+    // arena, number of quads up to the last one ever used, and the slots in
+    // between that were freed again.
+    GLsizei capacity = 0;
+    GLsizei used = 0;
+    std::vector<GLsizei> freeSlots;
+
+    GLsizei quadCount() const {
+      return (GLsizei) (vertices.size() / QUAD_VERTICES);
+    }
+
+    void clear() {
+      vertices.clear();
+    }
+  };
+
+  std::array<std::array<Bucket, FACE_COUNT>, PASS_COUNT> Buckets;
+
+  GeometryArena *Arena;
+  // All buckets share one allocation and are stored back to back, so the
+  // faces of one pass are contiguous.
+  ArenaRange Range;
+  std::array<std::array<ArenaRange, FACE_COUNT>, PASS_COUNT> BucketRanges;
 
-  GLuint vertexbuffer;
-  GLuint uvbuffer;
-  GLuint lightbuffer;
-  GLuint occlusionbuffer;
-
-  std::vector<GLfloat> vertexes;
-  std::vector<GLfloat> uvs;
-  std::vector<GLfloat> lights;
-  std::vector<GLfloat> occlusion;
+  bool Finalized = false;
+  bool HasBounds = false;
 
-  GLuint VertexArrayID;
+  glm::vec3 BoundsMin;
+  glm::vec3 BoundsMax;
 
-  TextureID Texture;
+  // Freed quads in all buckets. They are drawn as degenerate triangles.
+  GLsizei Holes = 0;
 
-  bool Finalized = false;
+  // Uploads the quads currently stored in the bucket, starting at the given
+  // slot.
+  void upload(Pass P, unsigned face, GLsizei slot) {
+    Bucket &B = Buckets[P][face];
+    ArenaRange R(BucketRanges[P][face].first + slot * QUAD_VERTICES,
+                 B.quadCount() * QUAD_VERTICES);
+    Arena->upload(R, B.vertices.data());
+  }
 
 public:
-  BlockSideArray(const std::string &TexturePath) : Texture(
-    TexMgr.loadTexture(TexturePath)) {
+  BlockSideArray(GeometryArena &Arena) : Arena(&Arena) {
   }
 
   ~BlockSideArray() {
     reset();
   }
 
-  void add(const std::vector<GLfloat> &v, const std::vector<GLfloat> &u,
-           float light, const std::array<GLfloat, 6> &o) {
-    vertexes.resize(vertexes.size() + 18);
-    std::memcpy(vertexes.data() + vertexes.size() - 18, v.data(),
-                sizeof(GLfloat) * 18);
-    uvs.resize(uvs.size() + 12);
-    std::memcpy(uvs.data() + uvs.size() - 12, u.data(), sizeof(GLfloat) * 12);
-    lights.push_back(light);
-    lights.push_back(light);
-    lights.push_back(light);
-    lights.push_back(light);
-    lights.push_back(light);
-    lights.push_back(light);
-
-    occlusion.resize(occlusion.size() + o.size());
-    std::memcpy(occlusion.data() + occlusion.size() - o.size(), o.data(), sizeof(GLfloat) * o.size());
-
-    //vertexes.insert(vertexes.begin(), v.begin(), v.end());
-    //uvs.insert(uvs.begin(), u.begin(), u.end());
+  // Adds the two triangles of a side. lightTexel is the light atlas texel
+  // of the voxel in front of the side. If reverse is set, the order of the
+  // vertices and all their attributes is flipped to turn the side into
+  // counter clockwise winding.
+  //
+  // After finalize() the side is written into a free slot of its bucket
+  // right away. Returns the slot of the side inside its bucket, or -1 if
+  // there was no room left.
+  int add(Pass P, unsigned face, bool reverse,
+          const std::vector<GLfloat> &v, const std::vector<GLfloat> &u,
+          const glm::vec3 &lightTexel, const std::array<GLfloat, 6> &o) {
+    Bucket &B = Buckets[P][face];
+    GLsizei slot = B.quadCount();
+    if (Finalized) {
+      if (!B.freeSlots.empty()) {
+        slot = B.freeSlots.back();
+        B.freeSlots.pop_back();
+        --Holes;
+      } else if (B.used < B.capacity) {
+        slot = B.used++;
+        BucketRanges[P][face].count = B.used * QUAD_VERTICES;
+      } else {
+        return -1;
+      }
+    }
+
+    for (size_t n = 0; n < 6; ++n) {
+      const size_t i = reverse ? 5 - n : n;
+      glm::vec3 p(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+      if (!HasBounds)
+        BoundsMin = BoundsMax = p;
+      HasBounds = true;
+      BoundsMin = glm::min(BoundsMin, p);
+      BoundsMax = glm::max(BoundsMax, p);
+
+      B.vertices.emplace_back();
+      GeometryArena::Vertex &V = B.vertices.back();
+      V.get<0>().set(p.x, p.y, p.z);
+      V.get<1>().setNormalized(u[i * 2], u[i * 2 + 1]);
+      V.get<2>().set(lightTexel.x, lightTexel.y, lightTexel.z);
+      V.get<3>().setNormalized(o[i]);
+    }
+
+    if (Finalized) {
+      upload(P, face, slot);
+      B.clear();
+    }
+    return (int) slot;
   }
 
-  void reset() {
-    vertexes.clear();
-    uvs.clear();
-    lights.clear();
-    occlusion.clear();
-    if (!Finalized)
-      return;
-    Finalized = false;
-    glDeleteBuffers(1, &vertexbuffer);
-    glDeleteBuffers(1, &uvbuffer);
-    glDeleteBuffers(1, &lightbuffer);
-    glDeleteBuffers(1, &occlusionbuffer);
-    glDeleteVertexArrays(1, &VertexArrayID);
+  // Removes a side that was added to a finalized array. Its slot is
+  // overwritten with a degenerate quad and reused by the next add().
+  void remove(Pass P, unsigned face, int slot) {
+    assert(Finalized);
+    Bucket &B = Buckets[P][face];
+    assert(B.quadCount() == 0);
+    B.vertices.resize(QUAD_VERTICES, GeometryArena::Vertex());
+    upload(P, face, slot);
+    B.clear();
+    B.freeSlots.push_back(slot);
+    ++Holes;
   }
 
-  void finalize() {
-    assert(!Finalized);
-    Finalized = true;
+  // Whether so many sides were removed that the array should be rebuilt.
+  bool fragmented() const {
+    GLsizei used = 0;
+    for (auto &PassBuckets : Buckets)
+      for (const Bucket &B : PassBuckets)
+        used += B.used;
+    return Holes > 64 && Holes * 2 > used;
+  }
 
-    glGenVertexArrays(1, &VertexArrayID);
-    glBindVertexArray(VertexArrayID);
+  bool empty() const {
+    return Range.empty();
+  }
 
-    glGenBuffers(1, &vertexbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertexes.size() * sizeof(GLfloat),
-                 vertexes.data(), GL_STATIC_DRAW);
+  // Bounding box of all added sides. Only valid if the array isn't empty.
+  // Removing sides doesn't shrink it.
+  const glm::vec3 &boundsMin() const {
+    return BoundsMin;
+  }
+
+  const glm::vec3 &boundsMax() const {
+    return BoundsMax;
+  }
 
-    glGenBuffers(1, &uvbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(GLfloat), uvs.data(),
-                 GL_STATIC_DRAW);
+  // Number of vertices of all passes and faces, including removed sides.
+  GLsizei vertexCount() const {
+    GLsizei count = 0;
+    for (auto &PassRanges : BucketRanges)
+      for (const ArenaRange &R : PassRanges)
+        count += R.count;
+    return count;
+  }
 
-    glGenBuffers(1, &lightbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, lightbuffer);
-    glBufferData(GL_ARRAY_BUFFER, lights.size() * sizeof(GLfloat),
-                 lights.data(), GL_STATIC_DRAW);
+  // The vertices of the given pass and face inside the arena.
+  const ArenaRange &getRange(Pass P, unsigned face) const {
+    return BucketRanges[P][face];
+  }
 
-    glGenBuffers(1, &occlusionbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, occlusionbuffer);
-    glBufferData(GL_ARRAY_BUFFER, occlusion.size() * sizeof(GLfloat),
-                 occlusion.data(), GL_STATIC_DRAW);
+  void reset() {
+    for (auto &PassBuckets : Buckets)
+      for (Bucket &B : PassBuckets) {
+        B.clear();
+        B.capacity = B.used = 0;
+        B.freeSlots.clear();
+      }
+    HasBounds = false;
+    Holes = 0;
+    if (!Finalized)
+      return;
+    Finalized = false;
+    Arena->free(Range);
+    Range = ArenaRange();
+    for (auto &PassRanges : BucketRanges)
+      PassRanges.fill(ArenaRange());
   }
 
-  void draw() {
-    if (vertexes.empty())
+  // Moves the added sides into the arena. Unless the array is never patched
+  // but only rebuilt, every bucket gets some slack, so sides can be added
+  // later without rebuilding everything. The CPU side copies are cleared but
+  // keep their capacity for the next rebuild.
+  void finalize(bool Patchable = true) {
+    assert(!Finalized);
+    Finalized = true;
+
+    GLsizei total = 0;
+    for (auto &PassBuckets : Buckets)
+      for (Bucket &B : PassBuckets)
+        total += B.quadCount();
+    // Empty sections don't keep any slack around.
+    if (total == 0)
       return;
 
-    Texture.activate();
-
-    // 1rst attribute buffer : vertices
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-    glVertexAttribPointer(
-      0,                  // attribute. No particular reason for 0, but must match the layout in the shader.
-      3,                  // size
-      GL_FLOAT,           // type
-      GL_FALSE,           // normalized?
-      0,                  // stride
-      (void *) 0          // array buffer offset
-    );
-
-    // 2nd attribute buffer : UVs
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-    glVertexAttribPointer(
-      1,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-      2,                                // size : U+V => 2
-      GL_FLOAT,                         // type
-      GL_FALSE,                         // normalized?
-      0,                                // stride
-      (void *) 0                        // array buffer offset
-    );
-
-    // 3nd attribute buffer : Lights
-    glEnableVertexAttribArray(2);
-    glBindBuffer(GL_ARRAY_BUFFER, lightbuffer);
-    glVertexAttribPointer(
-      2,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-      1,                                // size : one float
-      GL_FLOAT,                         // type
-      GL_FALSE,                         // normalized?
-      0,                                // stride
-      (void *) 0                        // array buffer offset
-    );
-
-    // 4nd attribute buffer : Occlussion lightning
-    glEnableVertexAttribArray(3);
-    glBindBuffer(GL_ARRAY_BUFFER, occlusionbuffer);
-    glVertexAttribPointer(
-      3,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-      1,                                // size : one float
-      GL_FLOAT,                         // type
-      GL_FALSE,                         // normalized?
-      0,                                // stride
-      (void *) 0                        // array buffer offset
-    );
-
-
-    // Draw the triangle !
-    glDrawArrays(GL_TRIANGLES, 0, vertexes.size() / 3);
-
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(3);
+    total = 0;
+    for (auto &PassBuckets : Buckets)
+      for (Bucket &B : PassBuckets) {
+        B.used = B.quadCount();
+        B.capacity = Patchable ? B.used + B.used / 4 + 4 : B.used;
+        total += B.capacity * QUAD_VERTICES;
+      }
+
+    Range = Arena->allocate(total);
+    GLint first = Range.first;
+    for (unsigned P = 0; P < PASS_COUNT; ++P) {
+      for (unsigned face = 0; face < FACE_COUNT; ++face) {
+        Bucket &B = Buckets[P][face];
+        BucketRanges[P][face] = ArenaRange(first, B.used * QUAD_VERTICES);
+        if (B.used)
+          upload((Pass) P, face, 0);
+        first += B.capacity * QUAD_VERTICES;
+        B.clear();
+      }
+    }
   }
 };
 
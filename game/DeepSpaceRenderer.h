@@ -2,32 +2,45 @@
 #define DEEPSPACERENDERER_H
 
 #include <random>
+#include <string>
 #include "v3.h"
 #include "StarArray.h"
+#include "StarField.h"
 #include "common/Common.h"
 
 class DeepSpaceRenderer {
   StarArray PlanetArray;
-  StarArray StarArray_;
+  StarField Stars;
 
 public:
-  DeepSpaceRenderer() : PlanetArray("earth.bmp:linear"), StarArray_("star.bmp:linear") {
+  // Bump when the generated scene changes, so cached copies are rebuilt.
+  static const int Version = 2;
+
+  static const int DefaultStarCount = 2700;
+
+  // Rough distance of the planet and the stars to the origin.
+  static constexpr float PlanetDistance = 13000;
+  static constexpr float StarDistance = 18000;
+
+  DeepSpaceRenderer(int StarCount = DefaultStarCount,
+                    unsigned Seed = std::default_random_engine::default_seed)
+    : PlanetArray("earth.bmp:linear"), Stars("star.bmp:linear") {
     const float size = 9000;
-    float distance = -13000;
+    float distance = -PlanetDistance;
     PlanetArray.add(Rec(v3f(size, -size, distance), v3f(size, size, distance), v3f(-size, size, distance), v3f(-size, -size, distance)), 1.0f);
     PlanetArray.finalize();
 
-    std::default_random_engine generator;
+    std::default_random_engine generator(Seed);
     std::uniform_real_distribution<double> angleDistribution(-PI, PI);
     std::uniform_real_distribution<double> sizeDistribution(0.1f, 1.4f);
     std::uniform_real_distribution<double> distanceDistribution(0.90f, 1.1f);
     std::uniform_real_distribution<double> lightDistribution(0, 1);
     std::uniform_int_distribution<int> textureDistribution(0, 5);
 
-    distance = 18000;
+    distance = StarDistance;
 
     const float starSize = 180;
-    int StarCount = 2700;
+    Stars.reserve(StarCount);
     for (int i = 0; i < StarCount; ++i) {
       double horizontalAngle = angleDistribution(generator);
       double verticalAngle = angleDistribution(generator);
@@ -43,38 +56,33 @@ public:
         v = 0;
 
 
-      v3f pos = v3f(
+      glm::vec3 pos(
         (float) (cos(verticalAngle) * sin(horizontalAngle)),
         (float) sin(verticalAngle),
         (float) (cos(verticalAngle) * cos(horizontalAngle)));
 
-      verticalAngle += PI / 2;
-
-      v3f helperUp = v3f(
-        (float) (cos(verticalAngle) * sin(horizontalAngle)),
-        (float) sin(verticalAngle),
-        (float) (cos(verticalAngle) * cos(horizontalAngle)));
-
-      v3f right = helperUp.cross(pos).normalize();
-
-      v3f up = right.cross(pos).normalize();
+      // The billboard itself is built in the vertex shader.
+      Stars.add(pos * (float) (distance * distanceFactor),
+                (float) (starSize * sizeFactor), u, v, (float) lightFactor);
+    }
 
-      up *= starSize * sizeFactor;
-      right *= starSize * sizeFactor;
-      pos *= distance * distanceFactor;
+    Stars.finalize();
+  }
 
-      StarArray_.add(Rec(pos + right + up,
-                        pos - right + up,
-                        pos - right - up,
-                        pos + right - up, std::make_pair(u * 0.5f, v * 0.5f), 0.5f, 0.5f
-      ), lightFactor);
-    }
+  // Identifies the scene generated with the given parameters, for caching
+  // renderings of it.
+  static std::string cacheKey(int StarCount = DefaultStarCount,
+                              unsigned Seed = std::default_random_engine::default_seed) {
+    return "v" + std::to_string(Version) + "-seed" + std::to_string(Seed) +
+           "-stars" + std::to_string(StarCount);
+  }
 
-    StarArray_.finalize();
+  // Has to be called with the star program in use.
+  void drawStars() {
+    Stars.draw();
   }
 
   void draw() {
-    StarArray_.draw();
     PlanetArray.draw();
   }
 };
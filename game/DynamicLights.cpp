@@ -0,0 +1 @@
+#include "DynamicLights.h"
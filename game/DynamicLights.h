@@ -0,0 +1,287 @@
+#ifndef DYNAMICLIGHTS_H
+#define DYNAMICLIGHTS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "RenderView.h"
+#include "RenderStats.h"
+#include "GLState.h"
+#include "Profiler.h"
+
+// A light that moves freely, like a flashlight or a spark. Unlike lamps it
+// isn't part of the voxel light, it's only applied while shading.
+struct PointLight {
+  glm::vec3 position;
+  float radius;
+  glm::vec3 color;
+
+  PointLight(const glm::vec3 &position, float radius, const glm::vec3 &color)
+    : position(position), radius(radius), color(color) {
+  }
+};
+
+// Clustered shading for point lights. The view frustum is split into
+// screen tiles and exponential depth slices, every frame each light is
+// assigned to the clusters its sphere overlaps, and the block fragment
+// shader only evaluates the lights of the cluster a fragment falls into.
+//
+// Lights, the per-cluster ranges and the light index lists are passed in
+// texture buffers. The cluster layout is compiled into the shaders through
+// the defines returned by getShaderDefines().
+class DynamicLights {
+public:
+  static const int ClustersX = 16;
+  static const int ClustersY = 9;
+  static const int ClustersZ = 24;
+  static const int ClusterCount = ClustersX * ClustersY * ClustersZ;
+
+  // Depth range of the slices. Everything closer falls into the first,
+  // everything further into the last slice.
+  static constexpr float SliceNear = 1.0f;
+  static constexpr float SliceFar = 512.0f;
+
+  // Texture units the buffers are bound to.
+  static const int LightsUnit = 2;
+  static const int ClustersUnit = 3;
+  static const int IndicesUnit = 4;
+
+private:
+  std::vector<PointLight> Lights;
+
+  // Clusters covered by a light, inclusive.
+  struct ClusterBox {
+    int x0, x1, y0, y1, z0, z1;
+  };
+  std::vector<ClusterBox> Boxes;
+  std::vector<unsigned> LightsInView;
+
+  std::vector<GLfloat> LightData;
+  // Offset into the index list and number of lights per cluster.
+  std::vector<GLuint> ClusterData;
+  std::vector<GLuint> IndexData;
+
+  GLuint Buffers[3];
+  GLuint Textures[3];
+  bool Initialized = false;
+
+  float ScreenWidth = 1;
+  float ScreenHeight = 1;
+
+  // Uniform locations of the three buffers and the cluster scale in every
+  // program bind() was called with.
+  struct ProgramLocations {
+    GLuint ProgramID;
+    GLint Samplers[3];
+    GLint ClusterScale;
+  };
+  std::vector<ProgramLocations> Locations;
+
+  const ProgramLocations &locationsOf(GLuint ProgramID) {
+    for (const ProgramLocations &L : Locations)
+      if (L.ProgramID == ProgramID)
+        return L;
+    const char *Names[3] = {"dynamicLights", "lightClusters", "lightIndices"};
+    ProgramLocations L;
+    L.ProgramID = ProgramID;
+    for (int i = 0; i < 3; ++i)
+      L.Samplers[i] = glGetUniformLocation(ProgramID, Names[i]);
+    L.ClusterScale = glGetUniformLocation(ProgramID, "clusterScale");
+    Locations.push_back(L);
+    return Locations.back();
+  }
+
+  // Texture unit of the given buffer.
+  static GLuint unit(int i) {
+    const int Units[3] = {LightsUnit, ClustersUnit, IndicesUnit};
+    return Units[i];
+  }
+
+  void init() {
+    Initialized = true;
+    glGenBuffers(3, Buffers);
+    glGenTextures(3, Textures);
+  }
+
+  // Uploads the data and points the buffer texture at it.
+  template<typename T>
+  void upload(int i, GLenum Format, const std::vector<T> &Data) {
+    GLState.bindBuffer(GL_TEXTURE_BUFFER, Buffers[i]);
+    // Never leave the buffer empty, binding it would fail.
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(1, Data.size()) * sizeof(T),
+                 nullptr, GL_STREAM_DRAW);
+    if (!Data.empty())
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, Data.size() * sizeof(T), Data.data());
+    GLState.bindTexture(unit(i), GL_TEXTURE_BUFFER, Textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, Format, Buffers[i]);
+  }
+
+  static int slice(float w) {
+    if (w <= SliceNear)
+      return 0;
+    int s = (int) (std::log(w / SliceNear) / std::log(SliceFar / SliceNear) * ClustersZ);
+    return std::min(ClustersZ - 1, s);
+  }
+
+  // Finds the clusters that the sphere of the light might touch. Returns
+  // false if it's not in view at all.
+  bool findClusters(const RenderView &View, const PointLight &L, ClusterBox &Box) const {
+    const glm::vec3 extent(L.radius);
+    if (!View.frustum.intersects(L.position - extent, L.position + extent))
+      return false;
+
+    // The view is rigid, so clip space w changes by exactly the distance
+    // moved along the view direction.
+    const float w = (View.MVP * glm::vec4(L.position, 1)).w;
+    Box.z0 = slice(w - L.radius);
+    Box.z1 = slice(w + L.radius);
+
+    // Bounding rectangle of the projected bounding box. Covers the whole
+    // screen if part of the box is behind the camera.
+    Box.x0 = 0;
+    Box.x1 = ClustersX - 1;
+    Box.y0 = 0;
+    Box.y1 = ClustersY - 1;
+    glm::vec2 min(1), max(-1);
+    for (int i = 0; i < 8; ++i) {
+      glm::vec3 corner(i & 1 ? extent.x : -extent.x,
+                       i & 2 ? extent.y : -extent.y,
+                       i & 4 ? extent.z : -extent.z);
+      glm::vec4 clip = View.MVP * glm::vec4(L.position + corner, 1);
+      if (clip.w < 0.01f)
+        return true;
+      glm::vec2 ndc = glm::vec2(clip) / clip.w;
+      min = glm::min(min, ndc);
+      max = glm::max(max, ndc);
+    }
+    auto toCluster = [](float ndc, int count) {
+      int c = (int) std::floor((ndc * 0.5f + 0.5f) * count);
+      return std::max(0, std::min(count - 1, c));
+    };
+    Box.x0 = toCluster(min.x, ClustersX);
+    Box.x1 = toCluster(max.x, ClustersX);
+    Box.y0 = toCluster(min.y, ClustersY);
+    Box.y1 = toCluster(max.y, ClustersY);
+    return true;
+  }
+
+  static int clusterIndex(int x, int y, int z) {
+    return x + y * ClustersX + z * ClustersX * ClustersY;
+  }
+
+public:
+  DynamicLights() {
+  }
+
+  ~DynamicLights() {
+    if (!Initialized)
+      return;
+    GLState.deleteBuffers(3, Buffers);
+    GLState.deleteTextures(3, Textures);
+  }
+
+  // Defines that enable dynamic lights in the block shaders.
+  static std::string getShaderDefines() {
+    std::stringstream ss;
+    ss << std::showpoint << "#define DYNAMIC_LIGHTS\n"
+       << "#define CLUSTERS_X " << ClustersX << "\n"
+       << "#define CLUSTERS_Y " << ClustersY << "\n"
+       << "#define CLUSTERS_Z " << ClustersZ << "\n"
+       << "#define SLICE_NEAR " << SliceNear << "\n"
+       << "#define SLICE_SCALE " << ClustersZ / std::log(SliceFar / SliceNear) << "\n";
+    return ss.str();
+  }
+
+  // Lights are submitted anew every frame.
+  void clear() {
+    Lights.clear();
+  }
+
+  void add(const PointLight &L) {
+    Lights.push_back(L);
+  }
+
+  size_t size() const {
+    return Lights.size();
+  }
+
+  // Size of the framebuffer in pixels, which the clusters are spread over.
+  void setScreenSize(int Width, int Height) {
+    ScreenWidth = Width;
+    ScreenHeight = Height;
+  }
+
+  // Assigns the lights to clusters and uploads everything for this frame.
+  void update(const RenderView &View) {
+    PROFILE_SCOPE("cluster lights");
+    auto Start = std::chrono::steady_clock::now();
+    if (!Initialized)
+      init();
+
+    Boxes.clear();
+    LightsInView.clear();
+    ClusterData.assign(ClusterCount * 2, 0);
+    for (unsigned i = 0; i < Lights.size(); ++i) {
+      ClusterBox Box;
+      if (!findClusters(View, Lights[i], Box))
+        continue;
+      Boxes.push_back(Box);
+      LightsInView.push_back(i);
+      for (int z = Box.z0; z <= Box.z1; ++z)
+        for (int y = Box.y0; y <= Box.y1; ++y)
+          for (int x = Box.x0; x <= Box.x1; ++x)
+            ++ClusterData[clusterIndex(x, y, z) * 2 + 1];
+    }
+
+    // Turn the counts into offsets, then fill the index lists.
+    GLuint offset = 0;
+    for (int c = 0; c < ClusterCount; ++c) {
+      ClusterData[c * 2] = offset;
+      offset += ClusterData[c * 2 + 1];
+      ClusterData[c * 2 + 1] = 0;
+    }
+    IndexData.resize(offset);
+    LightData.clear();
+    for (unsigned n = 0; n < LightsInView.size(); ++n) {
+      const PointLight &L = Lights[LightsInView[n]];
+      LightData.insert(LightData.end(), {L.position.x, L.position.y, L.position.z, L.radius,
+                                         L.color.r, L.color.g, L.color.b, 0});
+      const ClusterBox &Box = Boxes[n];
+      for (int z = Box.z0; z <= Box.z1; ++z)
+        for (int y = Box.y0; y <= Box.y1; ++y)
+          for (int x = Box.x0; x <= Box.x1; ++x) {
+            GLuint *Cluster = &ClusterData[clusterIndex(x, y, z) * 2];
+            IndexData[Cluster[0] + Cluster[1]++] = n;
+          }
+    }
+
+    upload(0, GL_RGBA32F, LightData);
+    upload(1, GL_RG32UI, ClusterData);
+    upload(2, GL_R32UI, IndexData);
+
+    Stats.DynamicLights += LightsInView.size();
+    Stats.LightIndices += IndexData.size();
+    Stats.ClusterMillis += std::chrono::duration<float, std::milli>(
+      std::chrono::steady_clock::now() - Start).count();
+  }
+
+  // Binds the buffers and sets the uniforms of the given block program,
+  // which has to be in use.
+  void bind(GLuint ProgramID) {
+    if (!Initialized)
+      init();
+    const ProgramLocations &L = locationsOf(ProgramID);
+    for (int i = 0; i < 3; ++i) {
+      GLState.bindTexture(unit(i), GL_TEXTURE_BUFFER, Textures[i]);
+      GLState.setSampler(L.Samplers[i], unit(i));
+    }
+    glUniform2f(L.ClusterScale, ClustersX / ScreenWidth, ClustersY / ScreenHeight);
+  }
+};
+
+#endif // DYNAMICLIGHTS_H
@@ -1,6 +1,7 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
+#include <algorithm>
 #include "v3.h"
 
 class Space;
@@ -10,8 +11,12 @@ protected:
   v3f pos;
   float rot = 0;
 
+  // Bounding box relative to pos.
+  v3f extentMin;
+  v3f extentMax;
+
 public:
-  Entity() : pos(55, 14, 55) {
+  Entity() : pos(55, 14, 55), extentMin(-0.5f, -0.5f, -0.5f), extentMax(0.5f, 0.5f, 0.5f) {
 
   }
 
@@ -26,6 +31,31 @@ public:
   float rotation() const {
     return rot;
   }
+
+  v3f boundsMin() const {
+    return pos + extentMin;
+  }
+
+  v3f boundsMax() const {
+    return pos + extentMax;
+  }
+
+  bool overlaps(const v3f &min, const v3f &max) const {
+    v3f bMin = boundsMin();
+    v3f bMax = boundsMax();
+    return bMin.x < max.x && bMax.x > min.x &&
+           bMin.y < max.y && bMax.y > min.y &&
+           bMin.z < max.z && bMax.z > min.z;
+  }
+
+  float distanceSquared(const v3f &p) const {
+    v3f bMin = boundsMin();
+    v3f bMax = boundsMax();
+    float dx = std::max(std::max(bMin.x - p.x, 0.0f), p.x - bMax.x);
+    float dy = std::max(std::max(bMin.y - p.y, 0.0f), p.y - bMax.y);
+    float dz = std::max(std::max(bMin.z - p.z, 0.0f), p.z - bMax.z);
+    return dx * dx + dy * dy + dz * dz;
+  }
 };
 
 #endif // ENTITY_H
@@ -0,0 +1 @@
+#include "EntityGrid.h"
@@ -0,0 +1,165 @@
+#ifndef ENTITYGRID_H
+#define ENTITYGRID_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include "Entity.h"
+
+// Broadphase for entity/entity and entity/voxel queries. Entities are hashed
+// into a uniform grid by their bounding box and only rehashed when they
+// actually cross a cell border.
+class EntityGrid {
+
+  struct CellHash {
+    size_t operator()(const v3 &v) const {
+      return (size_t) (v.x * 73856093) ^ (size_t) (v.y * 19349663) ^
+             (size_t) (v.z * 83492791);
+    }
+  };
+
+  struct CellRange {
+    v3 min, max;
+
+    bool operator==(const CellRange &Other) const {
+      return min == Other.min && max == Other.max;
+    }
+  };
+
+  float CellSize;
+
+  std::unordered_map<v3, std::vector<Entity *>, CellHash> Cells;
+  std::unordered_map<Entity *, CellRange> Ranges;
+
+  int64_t toCell(float f) const {
+    return (int64_t) std::floor(f / CellSize);
+  }
+
+  CellRange getRange(const v3f &min, const v3f &max) const {
+    return {v3(toCell(min.x), toCell(min.y), toCell(min.z)),
+            v3(toCell(max.x), toCell(max.y), toCell(max.z))};
+  }
+
+  void insert(Entity *E, const CellRange &R) {
+    for (int64_t x = R.min.x; x <= R.max.x; ++x)
+      for (int64_t y = R.min.y; y <= R.max.y; ++y)
+        for (int64_t z = R.min.z; z <= R.max.z; ++z)
+          Cells[v3(x, y, z)].push_back(E);
+  }
+
+  void erase(Entity *E, const CellRange &R) {
+    for (int64_t x = R.min.x; x <= R.max.x; ++x)
+      for (int64_t y = R.min.y; y <= R.max.y; ++y)
+        for (int64_t z = R.min.z; z <= R.max.z; ++z) {
+          auto I = Cells.find(v3(x, y, z));
+          if (I == Cells.end())
+            continue;
+          auto &List = I->second;
+          List.erase(std::remove(List.begin(), List.end(), E), List.end());
+          if (List.empty())
+            Cells.erase(I);
+        }
+  }
+
+  static bool overlaps(const Entity &A, const Entity &B) {
+    return A.overlaps(B.boundsMin(), B.boundsMax());
+  }
+
+public:
+  EntityGrid(float CellSize = 4) : CellSize(CellSize) {
+  }
+
+  void add(Entity &E) {
+    CellRange R = getRange(E.boundsMin(), E.boundsMax());
+    Ranges[&E] = R;
+    insert(&E, R);
+  }
+
+  void remove(Entity &E) {
+    auto I = Ranges.find(&E);
+    if (I == Ranges.end())
+      return;
+    erase(&E, I->second);
+    Ranges.erase(I);
+  }
+
+  // Has to be called after an entity changed its position. Entities that
+  // stay within the same cells are not touched.
+  void update(Entity &E) {
+    auto I = Ranges.find(&E);
+    if (I == Ranges.end())
+      return;
+    CellRange R = getRange(E.boundsMin(), E.boundsMax());
+    if (R == I->second)
+      return;
+    erase(&E, I->second);
+    insert(&E, R);
+    I->second = R;
+  }
+
+  size_t size() const {
+    return Ranges.size();
+  }
+
+  void queryBox(const v3f &min, const v3f &max, std::vector<Entity *> &Result) const {
+    const size_t start = Result.size();
+    CellRange R = getRange(min, max);
+    for (int64_t x = R.min.x; x <= R.max.x; ++x)
+      for (int64_t y = R.min.y; y <= R.max.y; ++y)
+        for (int64_t z = R.min.z; z <= R.max.z; ++z) {
+          auto I = Cells.find(v3(x, y, z));
+          if (I == Cells.end())
+            continue;
+          for (Entity *E : I->second)
+            if (E->overlaps(min, max))
+              Result.push_back(E);
+        }
+    // Entities spanning multiple cells are found once per cell.
+    std::sort(Result.begin() + start, Result.end());
+    Result.erase(std::unique(Result.begin() + start, Result.end()), Result.end());
+  }
+
+  void queryRadius(const v3f &center, float radius, std::vector<Entity *> &Result) const {
+    const size_t start = Result.size();
+    queryBox(v3f(center.x - radius, center.y - radius, center.z - radius),
+             v3f(center.x + radius, center.y + radius, center.z + radius), Result);
+    Result.erase(std::remove_if(Result.begin() + start, Result.end(),
+                                [&](Entity *E) {
+                                  return E->distanceSquared(center) > radius * radius;
+                                }), Result.end());
+  }
+
+  bool isOccupied(const v3 &voxel) const {
+    std::vector<Entity *> Result;
+    queryBox(v3f(voxel.x, voxel.y, voxel.z),
+             v3f(voxel.x + 1, voxel.y + 1, voxel.z + 1), Result);
+    return !Result.empty();
+  }
+
+  // Calls F(A, B) once for every pair of entities whose bounding boxes
+  // overlap. A pair sharing several cells is only reported by the cell that
+  // contains the lower corner of their intersection.
+  template<typename F>
+  void forEachOverlappingPair(F f) const {
+    for (auto &Cell : Cells) {
+      auto &List = Cell.second;
+      for (size_t i = 0; i < List.size(); ++i) {
+        for (size_t j = i + 1; j < List.size(); ++j) {
+          Entity *A = List[i];
+          Entity *B = List[j];
+          if (!overlaps(*A, *B))
+            continue;
+          v3f lower(std::max(A->boundsMin().x, B->boundsMin().x),
+                    std::max(A->boundsMin().y, B->boundsMin().y),
+                    std::max(A->boundsMin().z, B->boundsMin().z));
+          if (getRange(lower, lower).min != Cell.first)
+            continue;
+          f(*A, *B);
+        }
+      }
+    }
+  }
+};
+
+#endif // ENTITYGRID_H
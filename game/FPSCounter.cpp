@@ -1 +1,3 @@
 #include "FPSCounter.h"
+
+const size_t FPSCounter::HistorySize;
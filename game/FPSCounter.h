@@ -3,29 +3,208 @@
 
 #include <chrono>
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "RenderStats.h"
 
+// Records the duration of every frame and reports frame time percentiles
+// and hitches, which an average frame rate hides.
+//
+// The last HistorySize frames are kept in a ring that's allocated once, so
+// recording a frame is a handful of stores. Percentiles are only computed
+// when a report window closes.
 class FPSCounter {
-  unsigned frames = 0;
-  std::chrono::steady_clock::time_point lastStart;
+public:
+  // About 18 minutes at 60 frames per second.
+  static const size_t HistorySize = 1 << 16;
+
+  struct Frame {
+    // Time from the start of the recording to the end of the frame.
+    float EndMillis;
+    float Millis;
+    // Simulation ticks finished during the frame and their total duration.
+    unsigned Ticks;
+    float TickMillis;
+    unsigned DrawCalls;
+    unsigned Triangles;
+    unsigned Remeshes;
+    unsigned Patches;
+  };
+
+  struct Summary {
+    unsigned Frames = 0;
+    float Fps = 0;
+    float P50 = 0;
+    float P95 = 0;
+    float P99 = 0;
+    float Max = 0;
+    unsigned Hitches = 0;
+    float TickMillis = 0;
+  };
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  std::vector<Frame> History;
+  // Number of frames recorded so far, the last one is at
+  // (Recorded - 1) % HistorySize.
+  uint64_t Recorded = 0;
+
+  Clock::time_point Start;
+  Clock::time_point LastFrame;
+
+  float WindowMillis = 1000;
+  // Three frames at 60 Hz.
+  float HitchMillis = 50;
+  // First frame of the current report window and when it started.
+  uint64_t WindowFirst = 0;
+  float WindowStart = 0;
+
+  unsigned PendingTicks = 0;
+  float PendingTickMillis = 0;
+
+  std::vector<float> Sorted;
+
+  static float millisBetween(Clock::time_point From, Clock::time_point To) {
+    return std::chrono::duration<float, std::milli>(To - From).count();
+  }
+
+  // Nearest rank percentile of sorted values.
+  static float percentile(const std::vector<float> &Values, float P) {
+    size_t Rank = (size_t) std::ceil(P * Values.size());
+    return Values[std::max<size_t>(Rank, 1) - 1];
+  }
+
+  const Frame &frame(uint64_t Index) const {
+    return History[Index % HistorySize];
+  }
+
+  void print(const Summary &S, std::ostream &Out) const {
+    Out << S.Fps << " fps, frame ms p50 " << S.P50 << " p95 " << S.P95 << " p99 "
+        << S.P99 << " max " << S.Max << ", " << S.Hitches << " hitches";
+    if (S.TickMillis)
+      Out << ", " << S.TickMillis << " ms/tick";
+  }
 
 public:
-  FPSCounter() {
-    lastStart = std::chrono::steady_clock::now();
+  FPSCounter() : History(HistorySize) {
+    Start = LastFrame = Clock::now();
+  }
+
+  // Sets how many milliseconds of frames every report covers.
+  void setWindowMillis(float Millis) {
+    WindowMillis = Millis;
   }
 
-  long getMillis() {
-    auto diff = std::chrono::steady_clock::now() - lastStart;
-    return std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
+  // Frames that take longer than this count as hitches.
+  void setHitchMillis(float Millis) {
+    HitchMillis = Millis;
   }
 
+  // Records the duration of a simulation tick that finished since the last
+  // frame so frame and tick time can be reported side by side.
+  void addTick(float millis) {
+    ++PendingTicks;
+    PendingTickMillis += millis;
+  }
+
+  // Records the frame that ended now, together with the current Stats.
   void addFrame() {
-    ++frames;
-    auto millis = getMillis();
-    if (millis >= 1000) {
-      lastStart = std::chrono::steady_clock::now();
-      std::cout << (frames / (millis / 1000.0)) << std::endl;
-      frames = 0;
+    const Clock::time_point Now = Clock::now();
+    Frame &F = History[Recorded % HistorySize];
+    F.EndMillis = millisBetween(Start, Now);
+    F.Millis = millisBetween(LastFrame, Now);
+    F.Ticks = PendingTicks;
+    F.TickMillis = PendingTickMillis;
+    F.DrawCalls = Stats.DrawCalls;
+    F.Triangles = Stats.Triangles;
+    F.Remeshes = Stats.Remeshes;
+    F.Patches = Stats.Patches;
+    ++Recorded;
+    LastFrame = Now;
+    PendingTicks = 0;
+    PendingTickMillis = 0;
+
+    if (F.EndMillis - WindowStart >= WindowMillis) {
+      print(summarize(WindowFirst, Recorded), std::cout);
+      std::cout << ", " << Stats << std::endl;
+      WindowFirst = Recorded;
+      WindowStart = F.EndMillis;
+    }
+  }
+
+  // Summarizes the given range of recorded frames. Frames that dropped out
+  // of the history are skipped.
+  Summary summarize(uint64_t First, uint64_t End) {
+    if (End - std::min(End, First) > HistorySize)
+      First = End - HistorySize;
+    Summary S;
+    if (First >= End)
+      return S;
+
+    Sorted.clear();
+    float Total = 0;
+    unsigned Ticks = 0;
+    float TickMillis = 0;
+    for (uint64_t i = First; i < End; ++i) {
+      const Frame &F = frame(i);
+      Sorted.push_back(F.Millis);
+      Total += F.Millis;
+      S.Hitches += F.Millis > HitchMillis;
+      Ticks += F.Ticks;
+      TickMillis += F.TickMillis;
+    }
+    std::sort(Sorted.begin(), Sorted.end());
+
+    S.Frames = (unsigned) Sorted.size();
+    S.Fps = Total > 0 ? S.Frames / (Total / 1000) : 0;
+    S.P50 = percentile(Sorted, 0.5f);
+    S.P95 = percentile(Sorted, 0.95f);
+    S.P99 = percentile(Sorted, 0.99f);
+    S.Max = Sorted.back();
+    S.TickMillis = Ticks ? TickMillis / Ticks : 0;
+    return S;
+  }
+
+  // Summarizes the frames of the last given milliseconds.
+  Summary summarizeLast(float Millis) {
+    uint64_t First = Recorded;
+    const uint64_t Oldest = Recorded - std::min<uint64_t>(Recorded, HistorySize);
+    if (Recorded) {
+      const float Until = frame(Recorded - 1).EndMillis - Millis;
+      while (First > Oldest && frame(First - 1).EndMillis > Until)
+        --First;
+    }
+    return summarize(First, Recorded);
+  }
+
+  // Summarizes every frame still in the history.
+  Summary summarizeAll() {
+    return summarize(0, Recorded);
+  }
+
+  void printSummary(const Summary &S, std::ostream &Out) const {
+    Out << S.Frames << " frames, ";
+    print(S, Out);
+    Out << std::endl;
+  }
+
+  // Writes every frame still in the history as CSV. Returns false if the
+  // file couldn't be written.
+  bool writeCSV(const std::string &Path) const {
+    std::ofstream Out(Path);
+    Out << "frame,end_ms,frame_ms,ticks,tick_ms,draw_calls,triangles,remeshes,patches\n";
+    const uint64_t First = Recorded - std::min<uint64_t>(Recorded, HistorySize);
+    for (uint64_t i = First; i < Recorded; ++i) {
+      const Frame &F = frame(i);
+      Out << i << ',' << F.EndMillis << ',' << F.Millis << ',' << F.Ticks << ','
+          << F.TickMillis << ',' << F.DrawCalls << ',' << F.Triangles << ','
+          << F.Remeshes << ',' << F.Patches << '\n';
     }
+    return (bool) Out;
   }
 };
 
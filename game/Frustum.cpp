@@ -0,0 +1 @@
+#include "Frustum.h"
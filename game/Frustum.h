@@ -0,0 +1,46 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <array>
+#include <glm/glm.hpp>
+
+// View frustum as six planes extracted from a view projection matrix. The
+// plane normals point into the frustum.
+class Frustum {
+  std::array<glm::vec4, 6> Planes;
+
+public:
+  Frustum() {
+  }
+
+  Frustum(const glm::mat4 &MVP) {
+    // glm matrices are column major, so MVP[c][r] is row r of column c.
+    glm::vec4 row0(MVP[0][0], MVP[1][0], MVP[2][0], MVP[3][0]);
+    glm::vec4 row1(MVP[0][1], MVP[1][1], MVP[2][1], MVP[3][1]);
+    glm::vec4 row2(MVP[0][2], MVP[1][2], MVP[2][2], MVP[3][2]);
+    glm::vec4 row3(MVP[0][3], MVP[1][3], MVP[2][3], MVP[3][3]);
+
+    Planes[0] = row3 + row0; // left
+    Planes[1] = row3 - row0; // right
+    Planes[2] = row3 + row1; // bottom
+    Planes[3] = row3 - row1; // top
+    Planes[4] = row3 + row2; // near
+    Planes[5] = row3 - row2; // far
+  }
+
+  // Conservative box test: false only if the box is completely outside of
+  // at least one plane.
+  bool intersects(const glm::vec3 &min, const glm::vec3 &max) const {
+    for (const glm::vec4 &P : Planes) {
+      // The box corner furthest along the plane normal.
+      glm::vec3 corner(P.x >= 0 ? max.x : min.x,
+                       P.y >= 0 ? max.y : min.y,
+                       P.z >= 0 ? max.z : min.z);
+      if (P.x * corner.x + P.y * corner.y + P.z * corner.z + P.w < 0)
+        return false;
+    }
+    return true;
+  }
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,3 @@
+#include "GLState.h"
+
+GLStateCache GLState;
@@ -0,0 +1,196 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+#include <unordered_map>
+#include <cassert>
+#include "RenderStats.h"
+
+// Remembers the programs, vertex arrays, buffers and textures bound in the
+// GL context, and the sampler uniforms of every program, so binding what is
+// already bound doesn't reach the driver. All binds have to go through the
+// cache. Code that changes bindings behind its back has to call
+// invalidate() afterwards.
+//
+// Every call counts as a state change in Stats, the filtered ones also as
+// skipped.
+class GLStateCache {
+public:
+  static const GLuint TextureUnits = 8;
+
+private:
+  static constexpr GLuint Unknown = ~GLuint(0);
+
+  enum TextureTarget {
+    TEXTURE_2D,
+    TEXTURE_3D,
+    TEXTURE_CUBE_MAP,
+    TEXTURE_BUFFER,
+    TEXTURE_TARGET_COUNT
+  };
+
+  enum BufferTarget {
+    ARRAY_BUFFER,
+    TEXTURE_BUFFER_BUFFER,
+    COPY_READ_BUFFER,
+    COPY_WRITE_BUFFER,
+    PIXEL_PACK_BUFFER,
+    BUFFER_TARGET_COUNT
+  };
+
+  GLuint Program;
+  GLuint VertexArray;
+  GLuint ActiveUnit;
+  GLuint Buffers[BUFFER_TARGET_COUNT];
+  GLuint Textures[TextureUnits][TEXTURE_TARGET_COUNT];
+
+  // Values of sampler uniforms by program and location.
+  std::unordered_map<GLuint, std::unordered_map<GLint, GLint>> Samplers;
+
+  static TextureTarget textureTarget(GLenum Target) {
+    switch (Target) {
+      case GL_TEXTURE_2D:
+        return TEXTURE_2D;
+      case GL_TEXTURE_3D:
+        return TEXTURE_3D;
+      case GL_TEXTURE_CUBE_MAP:
+        return TEXTURE_CUBE_MAP;
+      case GL_TEXTURE_BUFFER:
+        return TEXTURE_BUFFER;
+      default:
+        assert(false && "untracked texture target");
+        return TEXTURE_2D;
+    }
+  }
+
+  static BufferTarget bufferTarget(GLenum Target) {
+    switch (Target) {
+      case GL_ARRAY_BUFFER:
+        return ARRAY_BUFFER;
+      case GL_TEXTURE_BUFFER:
+        return TEXTURE_BUFFER_BUFFER;
+      case GL_COPY_READ_BUFFER:
+        return COPY_READ_BUFFER;
+      case GL_COPY_WRITE_BUFFER:
+        return COPY_WRITE_BUFFER;
+      case GL_PIXEL_PACK_BUFFER:
+        return PIXEL_PACK_BUFFER;
+      default:
+        // The element array buffer belongs to the vertex array.
+        assert(false && "untracked buffer target");
+        return ARRAY_BUFFER;
+    }
+  }
+
+  // Stores Value in Cached and returns whether it was different.
+  static bool change(GLuint &Cached, GLuint Value) {
+    ++Stats.StateChanges;
+    if (Cached == Value) {
+      ++Stats.SkippedStateChanges;
+      return false;
+    }
+    Cached = Value;
+    return true;
+  }
+
+  void activeTexture(GLuint Unit) {
+    assert(Unit < TextureUnits);
+    if (change(ActiveUnit, Unit))
+      glActiveTexture(GL_TEXTURE0 + Unit);
+  }
+
+public:
+  GLStateCache() {
+    invalidate();
+  }
+
+  // Forgets everything, the next call of every kind reaches the driver.
+  void invalidate() {
+    Program = VertexArray = ActiveUnit = Unknown;
+    for (GLuint &B : Buffers)
+      B = Unknown;
+    for (auto &Unit : Textures)
+      for (GLuint &T : Unit)
+        T = Unknown;
+    Samplers.clear();
+  }
+
+  void useProgram(GLuint Name) {
+    if (change(Program, Name))
+      glUseProgram(Name);
+  }
+
+  void bindVertexArray(GLuint Name) {
+    if (change(VertexArray, Name))
+      glBindVertexArray(Name);
+  }
+
+  void bindBuffer(GLenum Target, GLuint Name) {
+    if (change(Buffers[bufferTarget(Target)], Name))
+      glBindBuffer(Target, Name);
+  }
+
+  // Binds the texture to the given unit, which is left active.
+  void bindTexture(GLuint Unit, GLenum Target, GLuint Name) {
+    assert(Unit < TextureUnits);
+    GLuint &Cached = Textures[Unit][textureTarget(Target)];
+    ++Stats.StateChanges;
+    if (Cached == Name) {
+      ++Stats.SkippedStateChanges;
+      return;
+    }
+    activeTexture(Unit);
+    Cached = Name;
+    glBindTexture(Target, Name);
+  }
+
+  // Points a sampler uniform of the program in use at a texture unit.
+  void setSampler(GLint Location, GLint Unit) {
+    assert(Program != Unknown);
+    if (Location < 0)
+      return;
+    auto &ProgramSamplers = Samplers[Program];
+    auto I = ProgramSamplers.find(Location);
+    ++Stats.StateChanges;
+    if (I != ProgramSamplers.end() && I->second == Unit) {
+      ++Stats.SkippedStateChanges;
+      return;
+    }
+    ProgramSamplers[Location] = Unit;
+    glUniform1i(Location, Unit);
+  }
+
+  // Deleting objects unbinds them, and their names can be handed out again.
+  void deleteProgram(GLuint Name) {
+    Samplers.erase(Name);
+    glDeleteProgram(Name);
+  }
+
+  void deleteVertexArrays(GLsizei Count, const GLuint *Names) {
+    for (GLsizei i = 0; i < Count; ++i)
+      if (VertexArray == Names[i])
+        VertexArray = 0;
+    glDeleteVertexArrays(Count, Names);
+  }
+
+  void deleteBuffers(GLsizei Count, const GLuint *Names) {
+    for (GLsizei i = 0; i < Count; ++i)
+      for (GLuint &B : Buffers)
+        if (B == Names[i])
+          B = 0;
+    glDeleteBuffers(Count, Names);
+  }
+
+  void deleteTextures(GLsizei Count, const GLuint *Names) {
+    for (GLsizei i = 0; i < Count; ++i)
+      for (auto &Unit : Textures)
+        for (GLuint &T : Unit)
+          if (T == Names[i])
+            T = 0;
+    glDeleteTextures(Count, Names);
+  }
+};
+
+extern GLStateCache GLState;
+
+#endif // GLSTATE_H
@@ -0,0 +1 @@
+#include "GeometryArena.h"
@@ -0,0 +1,196 @@
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include <GL/glew.h>
+#include <map>
+#include <iterator>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+#include "VertexLayout.h"
+#include "GLState.h"
+
+// A range of vertices inside a GeometryArena.
+struct ArenaRange {
+  GLint first;
+  GLsizei count;
+
+  ArenaRange(GLint first = 0, GLsizei count = 0) : first(first), count(count) {
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+};
+
+// Shared storage for the block geometry of all sections. Instead of owning
+// a vertex array and buffers each, sections allocate a range of vertices
+// inside one large buffer of interleaved vertices, so everything can be
+// drawn with a single vertex array and one glMultiDrawArrays call.
+//
+// A headless arena doesn't touch GL at all and keeps the vertices in a CPU
+// side buffer instead, so meshing works without a GL context.
+class GeometryArena {
+public:
+  // Position, UV, light atlas texel and occlusion. The UVs only address the
+  // texture atlas and the light texels are integers, so both fit in shorts.
+  typedef VertexLayout<Attribute<GLfloat, 3>, Attribute<GLushort, 2, true>,
+                       Attribute<GLushort, 3>, Attribute<GLubyte, 1, true>> Layout;
+  typedef Layout::Vertex Vertex;
+
+private:
+  bool Headless;
+  // The contents of a headless arena.
+  std::vector<Vertex> CpuVertices;
+
+  GLuint Buffer = 0;
+  GLuint VertexArrayID = 0;
+
+  // Capacity of the buffer in vertices.
+  GLsizei Capacity = 0;
+
+  // Free blocks, offset to size in vertices.
+  std::map<GLint, GLsizei> FreeBlocks;
+
+  bool Initialized = false;
+
+  static GLuint createBuffer(GLsizei NewCapacity) {
+    GLuint NewBuffer;
+    glGenBuffers(1, &NewBuffer);
+    GLState.bindBuffer(GL_ARRAY_BUFFER, NewBuffer);
+    glBufferData(GL_ARRAY_BUFFER, NewCapacity * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+    return NewBuffer;
+  }
+
+  void setupVertexArray() {
+    GLState.bindVertexArray(VertexArrayID);
+    GLState.bindBuffer(GL_ARRAY_BUFFER, Buffer);
+    Layout::setup();
+  }
+
+  void init() {
+    Initialized = true;
+    Capacity = 1 << 18;
+    FreeBlocks[0] = Capacity;
+    if (Headless) {
+      CpuVertices.resize(Capacity);
+      return;
+    }
+    Buffer = createBuffer(Capacity);
+    glGenVertexArrays(1, &VertexArrayID);
+    setupVertexArray();
+  }
+
+  // Reallocates the buffer with at least the given capacity and copies the
+  // existing data over.
+  void grow(GLsizei MinCapacity) {
+    GLsizei NewCapacity = Capacity;
+    while (NewCapacity < MinCapacity)
+      NewCapacity *= 2;
+
+    release(ArenaRange(Capacity, NewCapacity - Capacity));
+    if (Headless) {
+      CpuVertices.resize(NewCapacity);
+      Capacity = NewCapacity;
+      return;
+    }
+
+    GLuint NewBuffer = createBuffer(NewCapacity);
+    GLState.bindBuffer(GL_COPY_READ_BUFFER, Buffer);
+    GLState.bindBuffer(GL_COPY_WRITE_BUFFER, NewBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        Capacity * sizeof(Vertex));
+    GLState.deleteBuffers(1, &Buffer);
+    Buffer = NewBuffer;
+    Capacity = NewCapacity;
+    setupVertexArray();
+  }
+
+  void release(ArenaRange Range) {
+    auto Next = FreeBlocks.lower_bound(Range.first);
+    // Merge with the following free block.
+    if (Next != FreeBlocks.end() && Range.first + Range.count == Next->first) {
+      Range.count += Next->second;
+      Next = FreeBlocks.erase(Next);
+    }
+    // Merge with the preceding free block.
+    if (Next != FreeBlocks.begin()) {
+      auto Prev = std::prev(Next);
+      if (Prev->first + Prev->second == Range.first) {
+        Prev->second += Range.count;
+        return;
+      }
+    }
+    FreeBlocks[Range.first] = Range.count;
+  }
+
+public:
+  explicit GeometryArena(bool Headless = false) : Headless(Headless) {
+  }
+
+  ~GeometryArena() {
+    if (!Initialized || Headless)
+      return;
+    GLState.deleteBuffers(1, &Buffer);
+    GLState.deleteVertexArrays(1, &VertexArrayID);
+  }
+
+  ArenaRange allocate(GLsizei count) {
+    if (!Initialized)
+      init();
+    if (count == 0)
+      return ArenaRange();
+
+    for (auto I = FreeBlocks.begin(); I != FreeBlocks.end(); ++I) {
+      if (I->second < count)
+        continue;
+      ArenaRange Result(I->first, count);
+      GLsizei rest = I->second - count;
+      FreeBlocks.erase(I);
+      if (rest)
+        FreeBlocks[Result.first + count] = rest;
+      return Result;
+    }
+
+    grow(Capacity + count);
+    return allocate(count);
+  }
+
+  void free(ArenaRange Range) {
+    if (Range.empty())
+      return;
+    release(Range);
+  }
+
+  // Uploads Range.count vertices into the range.
+  void upload(const ArenaRange &Range, const Vertex *Vertices) {
+    if (Headless) {
+      std::copy(Vertices, Vertices + Range.count, CpuVertices.begin() + Range.first);
+      return;
+    }
+    GLState.bindBuffer(GL_ARRAY_BUFFER, Buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, Range.first * sizeof(Vertex),
+                    Range.count * sizeof(Vertex), Vertices);
+  }
+
+  bool headless() const {
+    return Headless;
+  }
+
+  // The vertices of the given range. Only headless arenas keep them.
+  const Vertex *vertices(const ArenaRange &Range) const {
+    assert(Headless && Range.first + Range.count <= (GLint) CpuVertices.size());
+    return CpuVertices.data() + Range.first;
+  }
+
+  // Draws all given ranges with one call.
+  void draw(const std::vector<GLint> &Firsts, const std::vector<GLsizei> &Counts) {
+    assert(Firsts.size() == Counts.size());
+    if (!Initialized || Headless || Firsts.empty())
+      return;
+    GLState.bindVertexArray(VertexArrayID);
+    glMultiDrawArrays(GL_TRIANGLES, Firsts.data(), Counts.data(), (GLsizei) Firsts.size());
+  }
+};
+
+#endif // GEOMETRYARENA_H
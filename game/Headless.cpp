@@ -0,0 +1 @@
+#include "Headless.h"
@@ -0,0 +1,136 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "World.h"
+#include "GeometryArena.h"
+#include "LightAtlas.h"
+#include "RemeshScheduler.h"
+#include "VoxelRenderMap.h"
+#include "RenderView.h"
+#include "FPSCounter.h"
+#include "InputRecording.h"
+
+// Runs the world without a window or GL context, one tick after another as
+// fast as possible. The player stands still and looks around, breaking and
+// placing a block every few ticks. Changed sections are meshed into CPU
+// side buffers just like they would be uploaded for rendering, so this
+// covers everything but the drawing itself.
+class HeadlessRunner {
+  World W;
+  GeometryArena Arena;
+  LightAtlas Lights;
+  RemeshScheduler Remesher;
+  VoxelRenderMap ShipRenderer;
+  VoxelRenderMap MeteorRenderer;
+  FPSCounter Counter;
+  uint64_t Ticks = 0;
+  InputRecording *Recording = nullptr;
+
+public:
+  // Ticks between two edits of the player.
+  static const unsigned EditInterval = 10;
+
+  HeadlessRunner()
+    : Arena(true), Lights(true), ShipRenderer(W.Ship, Arena, Lights, Remesher),
+      MeteorRenderer(W.Meteor, Arena, Lights, Remesher) {
+  }
+
+  World &getWorld() {
+    return W;
+  }
+
+  FPSCounter &getCounter() {
+    return Counter;
+  }
+
+  // Adds every following tick as a frame of its own to the given recording.
+  void setRecording(InputRecording *R) {
+    Recording = R;
+  }
+
+  // The input of the scripted player in the given tick.
+  static PlayerInput inputFor(uint64_t Tick) {
+    PlayerInput In;
+    In.horizAngle = Tick * 0.05f;
+    In.direction = glm::normalize(glm::vec3(std::cos(In.horizAngle), -0.6f,
+                                            std::sin(In.horizAngle)));
+    In.breakBlock = Tick % (2 * EditInterval) == 0;
+    In.placeBlock = Tick % (2 * EditInterval) == EditInterval;
+    return In;
+  }
+
+  // Simulates one tick and meshes everything it changed.
+  void step(const PlayerInput &In) {
+    auto Start = std::chrono::steady_clock::now();
+    Stats.reset();
+    W.Sim.setInput(In);
+    W.Sim.step();
+    ++Ticks;
+
+    float TickMillis;
+    while (W.Sim.takeTickMillis(TickMillis))
+      Counter.addTick(TickMillis);
+
+    for (const v3 &Pos : W.Sim.takeChangedBlocks()) {
+      ShipRenderer.patchBlock(Pos);
+      MeteorRenderer.patchBlock(Pos);
+    }
+    for (const auto &Box : W.Sim.takeChangedBoxes()) {
+      ShipRenderer.recreateBox(Box.first, Box.second);
+      MeteorRenderer.recreateBox(Box.first, Box.second);
+    }
+    ShipRenderer.updateLight();
+    MeteorRenderer.updateLight();
+
+    // Remeshing starts close to where the player looks, like in a frame.
+    const v3f P = W.Player.position();
+    const glm::vec3 Eye(P.x, P.y, P.z);
+    const glm::mat4 MVP = glm::perspective(45.0f, 16.0f / 9.0f, 0.1f, 3000.0f) *
+                          glm::lookAt(Eye, Eye + In.direction, glm::vec3(0, 1, 0));
+    RenderView View(MVP, Eye);
+    while (Remesher.size())
+      Remesher.run(View);
+
+    Counter.addFrame();
+
+    if (Recording) {
+      RecordedFrame Frame;
+      Frame.DeltaMillis = std::chrono::duration<float, std::milli>(
+                            std::chrono::steady_clock::now() - Start).count();
+      Frame.CameraPos = Eye;
+      Frame.ViewMatrix = glm::lookAt(Eye, Eye + In.direction, glm::vec3(0, 1, 0));
+      Frame.Ticks.push_back(In);
+      Recording->addFrame(std::move(Frame));
+    }
+  }
+
+  // Runs the given number of ticks with the scripted player.
+  void run(uint64_t Count) {
+    auto Start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < Count; ++i)
+      step(inputFor(Ticks));
+    std::cout << "Simulated " << Count << " ticks in "
+              << std::chrono::duration<float, std::milli>(
+                   std::chrono::steady_clock::now() - Start).count()
+              << " ms" << std::endl;
+  }
+
+  // Runs the ticks of a recording, ignoring its frames and cameras.
+  void replay(const InputRecording &R) {
+    auto Start = std::chrono::steady_clock::now();
+    for (const RecordedFrame &Frame : R.getFrames())
+      for (const PlayerInput &In : Frame.Ticks)
+        step(In);
+    std::cout << "Replayed " << R.countTicks() << " ticks in "
+              << std::chrono::duration<float, std::milli>(
+                   std::chrono::steady_clock::now() - Start).count()
+              << " ms" << std::endl;
+  }
+};
+
+#endif // HEADLESS_H
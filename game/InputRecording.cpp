@@ -0,0 +1 @@
+#include "InputRecording.h"
@@ -0,0 +1,163 @@
+#ifndef INPUTRECORDING_H
+#define INPUTRECORDING_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Simulation.h"
+
+// One frame of a recording: the camera it was drawn with and the input of
+// every tick that ran since the frame before.
+struct RecordedFrame {
+  // Wall time the frame took while recording.
+  float DeltaMillis = 0;
+  glm::vec3 CameraPos;
+  glm::mat4 ViewMatrix;
+  std::vector<PlayerInput> Ticks;
+};
+
+// Everything that drove a session from the outside, for replaying it.
+//
+// Instead of window events, this keeps the input each simulation tick
+// actually consumed. How many ticks run per frame depends on timing, but
+// feeding the same inputs to the ticks in the same order always ends in the
+// same world, which the hash stored at the end of a recording verifies.
+//
+// Values are written in the byte order of the machine.
+class InputRecording {
+  static constexpr const char *FileMagic = "TSREC1";
+  enum RecordType : uint8_t { FRAME_RECORD = 1, END_RECORD = 2 };
+
+  std::vector<RecordedFrame> Frames;
+  bool HasResult = false;
+  uint64_t WorldHash = 0;
+  uint64_t Ticks = 0;
+
+  template <typename T> static void write(std::ofstream &Out, const T &Value) {
+    Out.write(reinterpret_cast<const char *>(&Value), sizeof(Value));
+  }
+
+  template <typename T> static bool read(std::ifstream &In, T &Value) {
+    return (bool) In.read(reinterpret_cast<char *>(&Value), sizeof(Value));
+  }
+
+  static void writeInput(std::ofstream &Out, const PlayerInput &In) {
+    for (float f : {In.horizAngle, In.x, In.y, In.z, In.direction.x, In.direction.y,
+                    In.direction.z})
+      write(Out, f);
+    write(Out, (uint8_t) In.blockType);
+    write(Out, (uint8_t) (In.jump | In.breakBlock << 1 | In.placeBlock << 2));
+  }
+
+  static bool readInput(std::ifstream &In, PlayerInput &Result) {
+    uint8_t Type, Flags;
+    for (float *f : {&Result.horizAngle, &Result.x, &Result.y, &Result.z,
+                     &Result.direction.x, &Result.direction.y, &Result.direction.z})
+      read(In, *f);
+    read(In, Type);
+    if (!read(In, Flags) || Type >= Voxel::TYPE_COUNT)
+      return false;
+    Result.blockType = (Voxel::Types) Type;
+    Result.jump = Flags & 1;
+    Result.breakBlock = Flags & 2;
+    Result.placeBlock = Flags & 4;
+    return true;
+  }
+
+public:
+  void addFrame(RecordedFrame Frame) {
+    Frames.push_back(std::move(Frame));
+  }
+
+  const std::vector<RecordedFrame> &getFrames() const {
+    return Frames;
+  }
+
+  uint64_t countTicks() const {
+    uint64_t Count = 0;
+    for (const RecordedFrame &F : Frames)
+      Count += F.Ticks.size();
+    return Count;
+  }
+
+  // Stores the hash of the world the recorded session ended with, and the
+  // number of ticks it ran in total.
+  void setResult(uint64_t Hash, uint64_t TickCount) {
+    HasResult = true;
+    WorldHash = Hash;
+    Ticks = TickCount;
+  }
+
+  bool hasResult() const {
+    return HasResult;
+  }
+
+  uint64_t getWorldHash() const {
+    return WorldHash;
+  }
+
+  uint64_t getTicks() const {
+    return Ticks;
+  }
+
+  bool save(const std::string &Path) const {
+    std::ofstream Out(Path, std::ios::binary);
+    Out.write(FileMagic, std::strlen(FileMagic));
+    for (const RecordedFrame &F : Frames) {
+      write(Out, FRAME_RECORD);
+      write(Out, F.DeltaMillis);
+      write(Out, F.CameraPos);
+      write(Out, F.ViewMatrix);
+      write(Out, (uint32_t) F.Ticks.size());
+      for (const PlayerInput &In : F.Ticks)
+        writeInput(Out, In);
+    }
+    if (HasResult) {
+      write(Out, END_RECORD);
+      write(Out, WorldHash);
+      write(Out, Ticks);
+    }
+    return (bool) Out;
+  }
+
+  bool load(const std::string &Path) {
+    std::ifstream In(Path, std::ios::binary);
+    if (!In)
+      return false;
+    char Magic[8] = {};
+    In.read(Magic, std::strlen(FileMagic));
+    if (!In || std::strcmp(Magic, FileMagic) != 0)
+      return false;
+
+    Frames.clear();
+    HasResult = false;
+    uint8_t Type;
+    while (read(In, Type)) {
+      if (Type == END_RECORD) {
+        HasResult = read(In, WorldHash) && read(In, Ticks);
+        return HasResult;
+      }
+      if (Type != FRAME_RECORD)
+        return false;
+      RecordedFrame F;
+      uint32_t TickCount = 0;
+      read(In, F.DeltaMillis);
+      read(In, F.CameraPos);
+      read(In, F.ViewMatrix);
+      if (!read(In, TickCount))
+        return false;
+      F.Ticks.resize(TickCount);
+      for (PlayerInput &Input : F.Ticks)
+        if (!readInput(In, Input))
+          return false;
+      Frames.push_back(std::move(F));
+    }
+    // Without a result, the replay just can't be verified.
+    return true;
+  }
+};
+
+#endif // INPUTRECORDING_H
@@ -0,0 +1 @@
+#include "LightAtlas.h"
@@ -0,0 +1,147 @@
+#ifndef LIGHTATLAS_H
+#define LIGHTATLAS_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include "v3.h"
+#include "GLState.h"
+
+// Light values of all sections in one 3D texture. Every section owns a slot
+// of SlotSize^3 texels holding the light of its voxels plus a one voxel
+// border of its neighbours, so every side can look up the voxel in front of
+// it. Changing light only means uploading the changed texels instead of
+// remeshing the sections around it.
+//
+// The texels are mirrored on the CPU, which is also what partial uploads
+// and growing the texture read from. A headless atlas only has the mirror.
+class LightAtlas {
+public:
+  static const int SlotSize = 18;
+
+  // The texture unit the atlas is bound to.
+  static const GLuint Unit = 1;
+
+private:
+  static const int SlotsX = 14;
+  static const int SlotsY = 14;
+
+  static const int Width = SlotsX * SlotSize;
+  static const int Height = SlotsY * SlotSize;
+
+  bool Headless;
+  int SlotsZ;
+
+  // Texels in x + y * Width + z * Width * Height order, so the texture can
+  // grow along z without moving any slot.
+  std::vector<uint8_t> Texels;
+
+  std::vector<int> FreeSlots;
+
+  GLuint TextureID = 0;
+  bool Initialized = false;
+  // Whether the texture has to be recreated from Texels.
+  bool NeedsRecreate = true;
+
+  int depth() const {
+    return SlotsZ * SlotSize;
+  }
+
+  void addSlots(int first, int last) {
+    // Hand out low slots first.
+    for (int slot = last - 1; slot >= first; --slot)
+      FreeSlots.push_back(slot);
+  }
+
+  void recreate() {
+    if (!Initialized) {
+      Initialized = true;
+      glGenTextures(1, &TextureID);
+    }
+    NeedsRecreate = false;
+    GLState.bindTexture(Unit, GL_TEXTURE_3D, TextureID);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, Width, Height, depth(), 0,
+                 GL_RED, GL_UNSIGNED_BYTE, Texels.data());
+  }
+
+  size_t index(const v3 &texel) const {
+    return texel.x + texel.y * Width + texel.z * Width * Height;
+  }
+
+public:
+  explicit LightAtlas(bool Headless = false, int SlotsZ = 6)
+    : Headless(Headless), SlotsZ(SlotsZ), Texels(Width * Height * depth()) {
+    addSlots(0, SlotsX * SlotsY * SlotsZ);
+  }
+
+  ~LightAtlas() {
+    if (Initialized)
+      GLState.deleteTextures(1, &TextureID);
+  }
+
+  int allocate() {
+    if (FreeSlots.empty()) {
+      int OldSlots = SlotsX * SlotsY * SlotsZ;
+      SlotsZ *= 2;
+      Texels.resize(Width * Height * depth());
+      addSlots(OldSlots, SlotsX * SlotsY * SlotsZ);
+      NeedsRecreate = true;
+    }
+    int slot = FreeSlots.back();
+    FreeSlots.pop_back();
+    return slot;
+  }
+
+  void free(int slot) {
+    FreeSlots.push_back(slot);
+  }
+
+  // Texel coordinate of the first texel of the given slot.
+  v3 slotOrigin(int slot) const {
+    return v3(slot % SlotsX, (slot / SlotsX) % SlotsY, slot / (SlotsX * SlotsY)) * SlotSize;
+  }
+
+  // Light of the given texel inside the slot. Changes are only visible after
+  // they were uploaded.
+  uint8_t &at(int slot, const v3 &texel) {
+    assert(texel.x >= 0 && texel.y >= 0 && texel.z >= 0);
+    assert(texel.x < SlotSize && texel.y < SlotSize && texel.z < SlotSize);
+    return Texels[index(slotOrigin(slot) + texel)];
+  }
+
+  // Uploads the texels in [min, max) of the given slot.
+  void upload(int slot, const v3 &min, const v3 &max) {
+    if (Headless)
+      return;
+    if (NeedsRecreate) {
+      recreate();
+      return;
+    }
+    v3 start = slotOrigin(slot) + min;
+    GLState.bindTexture(Unit, GL_TEXTURE_3D, TextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, Width);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, Height);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, start.x, start.y, start.z,
+                    max.x - min.x, max.y - min.y, max.z - min.z,
+                    GL_RED, GL_UNSIGNED_BYTE, Texels.data() + index(start));
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+  }
+
+  // Binds the atlas to its texture unit.
+  void activate() {
+    if (Headless)
+      return;
+    if (NeedsRecreate)
+      recreate();
+    GLState.bindTexture(Unit, GL_TEXTURE_3D, TextureID);
+  }
+};
+
+#endif // LIGHTATLAS_H
@@ -18,6 +18,7 @@
 #include <math.h>
 #include "Voxel.h"
 #include "VoxelChunk.h"
+#include "EntityGrid.h"
 #include "stb_perlin.h"
 
 class MovingLight {
@@ -43,6 +44,8 @@ class Space {
 
   std::vector<VoxelChunk*> Chunks;
 
+  EntityGrid Entities;
+
   Voxel defaultVoxel;
 
 public:
@@ -71,6 +74,27 @@ public:
     return defaultVoxel;
   }
 
+  void addEntity(Entity &E) {
+    Entities.add(E);
+  }
+
+  void removeEntity(Entity &E) {
+    Entities.remove(E);
+  }
+
+  void entityMoved(Entity &E) {
+    Entities.update(E);
+  }
+
+  EntityGrid &getEntities() {
+    return Entities;
+  }
+
+  // Whether any entity would intersect a block placed at the given position.
+  bool isOccupied(const v3 &pos) const {
+    return Entities.isOccupied(pos);
+  }
+
   bool isGravityAffected(v3 pos) {
     for (int i = 0; i < 10; ++i) {
       Voxel &V = get(pos);
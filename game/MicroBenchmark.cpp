@@ -0,0 +1 @@
+#include "MicroBenchmark.h"
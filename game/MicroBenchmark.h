@@ -0,0 +1,169 @@
+#ifndef MICROBENCHMARK_H
+#define MICROBENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Times small pieces of code. Every benchmark body is first run until a
+// batch of calls takes long enough to measure, then some batches are run
+// as warmup and some more are timed. Times are reported per item, where
+// one call of the body can handle any number of items.
+//
+// Results can be written as JSON to compare them across changes.
+class MicroBenchmark {
+public:
+  struct Result {
+    std::string Name;
+    // Calls of the body per batch, items per call.
+    uint64_t Iterations = 0;
+    uint64_t Items = 0;
+    unsigned Repetitions = 0;
+    // Nanoseconds per item over the timed batches.
+    double MinNanos = 0;
+    double MedianNanos = 0;
+    double MeanNanos = 0;
+    double MaxNanos = 0;
+    double StdDevNanos = 0;
+  };
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  unsigned Warmup = 2;
+  unsigned Repetitions = 10;
+  // Batches are made at least this long.
+  double BatchMillis = 20;
+  // Only benchmarks whose name contains this are run.
+  std::string Filter;
+
+  std::vector<Result> Results;
+
+  static double runBatch(uint64_t Iterations, const std::function<void()> &Body) {
+    auto Start = Clock::now();
+    for (uint64_t i = 0; i < Iterations; ++i)
+      Body();
+    return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+  }
+
+  static void writeString(std::ostream &Out, const std::string &S) {
+    Out << '"';
+    for (char c : S) {
+      if (c == '"' || c == '\\')
+        Out << '\\';
+      Out << c;
+    }
+    Out << '"';
+  }
+
+public:
+  void setWarmup(unsigned Batches) {
+    Warmup = Batches;
+  }
+
+  void setRepetitions(unsigned Batches) {
+    Repetitions = std::max(1u, Batches);
+  }
+
+  void setBatchMillis(double Millis) {
+    BatchMillis = Millis;
+  }
+
+  void setFilter(const std::string &F) {
+    Filter = F;
+  }
+
+  const std::vector<Result> &getResults() const {
+    return Results;
+  }
+
+  // Times Body, which handles Items items per call, and prints the result.
+  // Setup runs before every batch without being timed, e.g. to restore
+  // state the body changes.
+  void run(const std::string &Name, uint64_t Items, const std::function<void()> &Body,
+           const std::function<void()> &Setup = nullptr) {
+    if (Name.find(Filter) == std::string::npos)
+      return;
+
+    uint64_t Iterations = 1;
+    while (true) {
+      if (Setup)
+        Setup();
+      const double Millis = runBatch(Iterations, Body);
+      if (Millis >= BatchMillis)
+        break;
+      // Aim a bit over the batch time, but at most ten times as many calls.
+      const double Factor = Millis > 0 ? BatchMillis * 1.2 / Millis : 10;
+      Iterations = std::max(Iterations + 1, (uint64_t) (Iterations * std::min(Factor, 10.0)));
+    }
+
+    for (unsigned i = 0; i < Warmup; ++i) {
+      if (Setup)
+        Setup();
+      runBatch(Iterations, Body);
+    }
+
+    std::vector<double> Nanos;
+    for (unsigned i = 0; i < Repetitions; ++i) {
+      if (Setup)
+        Setup();
+      Nanos.push_back(runBatch(Iterations, Body) * 1e6 / (Iterations * Items));
+    }
+    std::sort(Nanos.begin(), Nanos.end());
+
+    Result R;
+    R.Name = Name;
+    R.Iterations = Iterations;
+    R.Items = Items;
+    R.Repetitions = Repetitions;
+    R.MinNanos = Nanos.front();
+    R.MaxNanos = Nanos.back();
+    R.MedianNanos = Nanos.size() % 2 ? Nanos[Nanos.size() / 2]
+                                     : (Nanos[Nanos.size() / 2 - 1] + Nanos[Nanos.size() / 2]) / 2;
+    for (double N : Nanos)
+      R.MeanNanos += N / Nanos.size();
+    for (double N : Nanos)
+      R.StdDevNanos += (N - R.MeanNanos) * (N - R.MeanNanos) / Nanos.size();
+    R.StdDevNanos = std::sqrt(R.StdDevNanos);
+    Results.push_back(R);
+
+    std::printf("%-40s %12.1f ns median %12.1f ns min %8.1f%% stddev  (%llu x %llu items)\n",
+                Name.c_str(), R.MedianNanos, R.MinNanos,
+                R.MeanNanos > 0 ? R.StdDevNanos * 100 / R.MeanNanos : 0.0,
+                (unsigned long long) Iterations, (unsigned long long) Items);
+  }
+
+  bool writeJSON(const std::string &Path) const {
+    std::ofstream Out(Path);
+    Out << "{\"unit\": \"ns per item\", \"benchmarks\": [\n";
+    for (size_t i = 0; i < Results.size(); ++i) {
+      const Result &R = Results[i];
+      Out << "{\"name\": ";
+      writeString(Out, R.Name);
+      Out << ", \"iterations\": " << R.Iterations << ", \"items\": " << R.Items
+          << ", \"repetitions\": " << R.Repetitions << ", \"min\": " << R.MinNanos
+          << ", \"median\": " << R.MedianNanos << ", \"mean\": " << R.MeanNanos
+          << ", \"max\": " << R.MaxNanos << ", \"stddev\": " << R.StdDevNanos << "}"
+          << (i + 1 < Results.size() ? ",\n" : "\n");
+    }
+    Out << "]}\n";
+    return (bool) Out;
+  }
+
+  // Keeps the compiler from optimizing away the computation of Value.
+  template <typename T> static void keep(const T &Value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&Value) : "memory");
+#else
+    static volatile const void *Sink;
+    Sink = &Value;
+#endif
+  }
+};
+
+#endif // MICROBENCHMARK_H
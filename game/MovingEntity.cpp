@@ -2,6 +2,21 @@
 
 #include "Map.h"
 
+MovingEntity::MovingEntity(Space *space) : space(space), vel(0, 0, 0) {
+  vel.y = -0.4f;
+  extentMin = v3f(-0.3f, -1.5f, -0.3f);
+  extentMax = v3f(0.3f, 0.3f, 0.3f);
+  space->addEntity(*this);
+}
+
+MovingEntity::~MovingEntity() {
+  space->removeEntity(*this);
+}
+
+void MovingEntity::moved() {
+  space->entityMoved(*this);
+}
+
 bool MovingEntity::isHeightGood(float h) {
   static const float r = 0.3f;
   return
@@ -10,6 +10,10 @@ class MovingEntity : public Entity {
 
   bool isHeightGood(float h);
 
+  // Updates the entity grid of the space, so it has to follow every change
+  // of pos.
+  void moved();
+
   bool gravityAffected() const;
 
   bool isPosGood() {
@@ -27,9 +31,15 @@ class MovingEntity : public Entity {
   }
 
 public:
-  MovingEntity(Space *space) : space(space), vel(0, 0, 0) {
-    vel.y = -0.4f;
-  }
+  // Registers the entity in the space until it's destroyed.
+  MovingEntity(Space *space);
+
+  ~MovingEntity();
+
+  // The space keeps a pointer to the entity, which a copy wouldn't update.
+  // Declaring these also rules out moving.
+  MovingEntity(const MovingEntity &) = delete;
+  MovingEntity &operator=(const MovingEntity &) = delete;
 
   bool isCollidingWith(v3 p, float h) {
     static const float r = 0.3f;
@@ -77,6 +87,7 @@ public:
       tryIncrease(pos.y, vel.y * dtime);
     }
     tryIncrease(pos.z, vel.z * dtime);
+    moved();
   }
 
   bool onGround() {
@@ -0,0 +1 @@
+#include "OcclusionBuffer.h"
@@ -0,0 +1,237 @@
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <chrono>
+#include <glm/glm.hpp>
+#include "Profiler.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_USE_SSE 1
+#endif
+
+// Low resolution software depth buffer for occlusion culling on the CPU.
+// Each frame a handful of boxes that are known to be completely opaque are
+// rasterized into it, and bounding boxes can then be tested against it
+// before they are drawn. Depth is the clip space w, i.e. the distance
+// along the view direction.
+//
+// Both sides are conservative: occluders only cover pixels they cover
+// completely and are written with their furthest depth, while tested boxes
+// cover their whole screen rectangle with their nearest depth.
+class OcclusionBuffer {
+public:
+  static const int Width = 256;
+  static const int Height = 128;
+
+private:
+  // Clip space w below which boxes are treated as crossing the near plane.
+  static constexpr float NearW = 0.1f;
+
+  std::vector<float> Depth;
+
+  glm::mat4 MVP;
+
+  struct Occluder {
+    float distance;
+    glm::vec3 min, max;
+
+    bool operator<(const Occluder &Other) const {
+      return distance < Other.distance;
+    }
+  };
+  std::vector<Occluder> Candidates;
+
+  size_t MaxOccluders;
+
+  float LastMillis = 0;
+
+  // Projects the corners of the box into buffer pixel coordinates. Returns
+  // false if a corner is behind the near plane.
+  bool project(const glm::vec3 &min, const glm::vec3 &max,
+               std::array<glm::vec2, 8> &Points, float &minW, float &maxW) const {
+    minW = std::numeric_limits<float>::max();
+    maxW = 0;
+    for (int i = 0; i < 8; ++i) {
+      glm::vec4 clip = MVP * glm::vec4(i & 1 ? max.x : min.x,
+                                       i & 2 ? max.y : min.y,
+                                       i & 4 ? max.z : min.z, 1);
+      if (clip.w < NearW)
+        return false;
+      Points[i] = glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * Width,
+                            (clip.y / clip.w * 0.5f + 0.5f) * Height);
+      minW = std::min(minW, clip.w);
+      maxW = std::max(maxW, clip.w);
+    }
+    return true;
+  }
+
+  static float cross(const glm::vec2 &o, const glm::vec2 &a, const glm::vec2 &b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+  }
+
+  // Convex hull of the projected corners in counter clockwise order
+  // (monotone chain).
+  static size_t convexHull(std::array<glm::vec2, 8> &Points, std::array<glm::vec2, 16> &Hull) {
+    std::sort(Points.begin(), Points.end(), [](const glm::vec2 &A, const glm::vec2 &B) {
+      return A.x < B.x || (A.x == B.x && A.y < B.y);
+    });
+    size_t k = 0;
+    for (size_t i = 0; i < Points.size(); ++i) {
+      while (k >= 2 && cross(Hull[k - 2], Hull[k - 1], Points[i]) <= 0)
+        --k;
+      Hull[k++] = Points[i];
+    }
+    for (size_t i = Points.size() - 1, t = k + 1; i > 0; --i) {
+      while (k >= t && cross(Hull[k - 2], Hull[k - 1], Points[i - 1]) <= 0)
+        --k;
+      Hull[k++] = Points[i - 1];
+    }
+    return k - 1;
+  }
+
+  // Writes depth into all pixels that are completely inside the convex
+  // polygon.
+  void rasterizeConvex(const std::array<glm::vec2, 16> &Hull, size_t n, float depth) {
+    if (n < 3)
+      return;
+
+    // Edge functions A * x + B * y + C >= T, where T moves the edge inwards
+    // by half a pixel so only fully covered pixels pass.
+    std::array<float, 16> A, B, C, T;
+    float minX = Width, maxX = 0, minY = Height, maxY = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const glm::vec2 &p0 = Hull[i];
+      const glm::vec2 &p1 = Hull[(i + 1) % n];
+      A[i] = -(p1.y - p0.y);
+      B[i] = p1.x - p0.x;
+      C[i] = -(A[i] * p0.x + B[i] * p0.y);
+      T[i] = 0.5f * (std::abs(A[i]) + std::abs(B[i]));
+      minX = std::min(minX, p0.x);
+      maxX = std::max(maxX, p0.x);
+      minY = std::min(minY, p0.y);
+      maxY = std::max(maxY, p0.y);
+    }
+
+    int x0 = std::max(0, (int) std::floor(minX)) & ~3;
+    int x1 = std::min(Width, (int) std::ceil(maxX));
+    int y0 = std::max(0, (int) std::floor(minY));
+    int y1 = std::min(Height, (int) std::ceil(maxY));
+
+    for (int y = y0; y < y1; ++y) {
+      float *Row = Depth.data() + y * Width;
+      const float py = y + 0.5f;
+#ifdef OCCLUSION_USE_SSE
+      const __m128 d = _mm_set1_ps(depth);
+      for (int x = x0; x < x1; x += 4) {
+        const __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3, 2, 1, 0));
+        __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t i = 0; i < n; ++i) {
+          __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[i]), px),
+                                _mm_set1_ps(B[i] * py + C[i]));
+          mask = _mm_and_ps(mask, _mm_cmpge_ps(e, _mm_set1_ps(T[i])));
+        }
+        __m128 old = _mm_loadu_ps(Row + x);
+        __m128 written = _mm_min_ps(old, d);
+        _mm_storeu_ps(Row + x, _mm_or_ps(_mm_and_ps(mask, written),
+                                         _mm_andnot_ps(mask, old)));
+      }
+#else
+      for (int x = x0; x < x1; ++x) {
+        const float px = x + 0.5f;
+        bool inside = true;
+        for (size_t i = 0; i < n && inside; ++i)
+          inside = A[i] * px + B[i] * py + C[i] >= T[i];
+        if (inside)
+          Row[x] = std::min(Row[x], depth);
+      }
+#endif
+    }
+  }
+
+public:
+  OcclusionBuffer(size_t MaxOccluders = 32)
+    : Depth(Width * Height), MaxOccluders(MaxOccluders) {
+  }
+
+  // Starts a new frame with an empty buffer.
+  void begin(const glm::mat4 &NewMVP) {
+    MVP = NewMVP;
+    Candidates.clear();
+    std::fill(Depth.begin(), Depth.end(), std::numeric_limits<float>::max());
+  }
+
+  void addOccluder(const glm::vec3 &min, const glm::vec3 &max, float distance) {
+    Candidates.push_back({distance, min, max});
+  }
+
+  // Rasterizes the closest occluders that were added since begin().
+  void rasterize() {
+    PROFILE_SCOPE("occlusion");
+    auto Start = std::chrono::steady_clock::now();
+
+    size_t count = std::min(MaxOccluders, Candidates.size());
+    std::partial_sort(Candidates.begin(), Candidates.begin() + count, Candidates.end());
+
+    std::array<glm::vec2, 8> Points;
+    std::array<glm::vec2, 16> Hull;
+    for (size_t i = 0; i < count; ++i) {
+      float minW, maxW;
+      if (!project(Candidates[i].min, Candidates[i].max, Points, minW, maxW))
+        continue;
+      size_t n = convexHull(Points, Hull);
+      rasterizeConvex(Hull, n, maxW);
+    }
+
+    LastMillis = std::chrono::duration<float, std::milli>(
+      std::chrono::steady_clock::now() - Start).count();
+  }
+
+  // Whether any part of the box might be visible.
+  bool isVisible(const glm::vec3 &min, const glm::vec3 &max) const {
+    std::array<glm::vec2, 8> Points;
+    float minW, maxW;
+    if (!project(min, max, Points, minW, maxW))
+      return true;
+
+    float minX = Width, maxX = 0, minY = Height, maxY = 0;
+    for (const glm::vec2 &p : Points) {
+      minX = std::min(minX, p.x);
+      maxX = std::max(maxX, p.x);
+      minY = std::min(minY, p.y);
+      maxY = std::max(maxY, p.y);
+    }
+
+    int x0 = std::max(0, (int) std::floor(minX));
+    int x1 = std::min(Width, (int) std::ceil(maxX));
+    int y0 = std::max(0, (int) std::floor(minY));
+    int y1 = std::min(Height, (int) std::ceil(maxY));
+
+    for (int y = y0; y < y1; ++y) {
+      const float *Row = Depth.data() + y * Width;
+      int x = x0;
+#ifdef OCCLUSION_USE_SSE
+      const __m128 w = _mm_set1_ps(minW);
+      for (; x + 4 <= x1; x += 4)
+        if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(Row + x), w)))
+          return true;
+#endif
+      for (; x < x1; ++x)
+        if (Row[x] >= minW)
+          return true;
+    }
+    return false;
+  }
+
+  // Time the last rasterize() call took.
+  float getMillis() const {
+    return LastMillis;
+  }
+};
+
+#endif // OCCLUSIONBUFFER_H
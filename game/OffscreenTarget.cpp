@@ -0,0 +1 @@
+#include "OffscreenTarget.h"
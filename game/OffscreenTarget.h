@@ -0,0 +1,184 @@
+#ifndef OFFSCREENTARGET_H
+#define OFFSCREENTARGET_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "GLState.h"
+
+// A framebuffer with color and depth renderbuffers to render into without
+// showing anything, plus asynchronous readback of the rendered frames.
+//
+// readback() only starts copying the color buffer into one of a few pixel
+// buffer objects and puts a fence behind it. The pixels are mapped once the
+// fence passed, usually a couple of frames later, so reading frames back
+// doesn't stall the pipeline like a plain glReadPixels would.
+class OffscreenTarget {
+public:
+  // Called with the frame number given to readback() and the RGBA pixels
+  // of the frame, bottom row first.
+  typedef std::function<void(uint64_t, const uint8_t *)> FrameCallback;
+
+private:
+  struct Readback {
+    GLuint Buffer = 0;
+    GLsync Fence = nullptr;
+    uint64_t Frame = 0;
+  };
+
+  int Width, Height;
+  GLuint Framebuffer = 0;
+  GLuint ColorBuffer = 0;
+  GLuint DepthBuffer = 0;
+
+  std::vector<Readback> Readbacks;
+  // Readbacks in flight are Next - InFlight up to Next, modulo the size.
+  size_t Next = 0;
+  size_t InFlight = 0;
+
+  size_t frameBytes() const {
+    return (size_t) Width * Height * 4;
+  }
+
+  // Hands the oldest readback in flight to Callback. Waits for it if Wait
+  // is set, otherwise returns false if it isn't done yet.
+  bool finishOldest(bool Wait, const FrameCallback &Callback) {
+    Readback &R = Readbacks[(Next + Readbacks.size() - InFlight) % Readbacks.size()];
+    GLenum Result;
+    do {
+      Result = glClientWaitSync(R.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, Wait ? 1000000000 : 0);
+    } while (Wait && Result == GL_TIMEOUT_EXPIRED);
+    if (Result == GL_TIMEOUT_EXPIRED)
+      return false;
+    glDeleteSync(R.Fence);
+    R.Fence = nullptr;
+    --InFlight;
+
+    GLState.bindBuffer(GL_PIXEL_PACK_BUFFER, R.Buffer);
+    if (Callback) {
+      const void *Pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes(),
+                                            GL_MAP_READ_BIT);
+      if (Pixels)
+        Callback(R.Frame, static_cast<const uint8_t *>(Pixels));
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    GLState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+  }
+
+public:
+  // BufferCount is the number of frames that can be in flight for
+  // readback at once.
+  OffscreenTarget(int Width, int Height, unsigned BufferCount = 3)
+    : Width(Width), Height(Height), Readbacks(BufferCount) {
+    glGenRenderbuffers(1, &ColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, ColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+    glGenRenderbuffers(1, &DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              ColorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                              DepthBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (Readback &R : Readbacks) {
+      glGenBuffers(1, &R.Buffer);
+      GLState.bindBuffer(GL_PIXEL_PACK_BUFFER, R.Buffer);
+      glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes(), nullptr, GL_STREAM_READ);
+    }
+    GLState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  ~OffscreenTarget() {
+    for (Readback &R : Readbacks) {
+      if (R.Fence)
+        glDeleteSync(R.Fence);
+      GLState.deleteBuffers(1, &R.Buffer);
+    }
+    glDeleteFramebuffers(1, &Framebuffer);
+    glDeleteRenderbuffers(1, &ColorBuffer);
+    glDeleteRenderbuffers(1, &DepthBuffer);
+  }
+
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  int getWidth() const {
+    return Width;
+  }
+
+  int getHeight() const {
+    return Height;
+  }
+
+  // Whether the framebuffer can be rendered into.
+  bool complete() {
+    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+    bool Result = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return Result;
+  }
+
+  // Directs rendering into the target.
+  void bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+    glViewport(0, 0, Width, Height);
+  }
+
+  // Starts reading back what was rendered so far as the given frame. If all
+  // buffers are in flight, this first waits for the oldest one.
+  void readback(uint64_t Frame, const FrameCallback &Callback) {
+    if (InFlight == Readbacks.size())
+      finishOldest(true, Callback);
+
+    Readback &R = Readbacks[Next];
+    R.Frame = Frame;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    GLState.bindBuffer(GL_PIXEL_PACK_BUFFER, R.Buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    GLState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    R.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    Next = (Next + 1) % Readbacks.size();
+    ++InFlight;
+  }
+
+  // Hands all finished readbacks to Callback, oldest first. With Wait set
+  // this also waits for the ones still in flight.
+  void collect(bool Wait, const FrameCallback &Callback) {
+    while (InFlight && finishOldest(Wait, Callback)) {
+    }
+  }
+
+  // Writes RGBA pixels as returned by readback() to a binary PPM file.
+  static bool savePPM(const std::string &Path, int Width, int Height,
+                      const uint8_t *Pixels) {
+    FILE *F = fopen(Path.c_str(), "wb");
+    if (!F)
+      return false;
+    fprintf(F, "P6\n%d %d\n255\n", Width, Height);
+    std::vector<uint8_t> Row(Width * 3);
+    // PPM starts at the top row.
+    for (int y = Height - 1; y >= 0; --y) {
+      const uint8_t *Src = Pixels + (size_t) y * Width * 4;
+      for (int x = 0; x < Width; ++x)
+        for (int c = 0; c < 3; ++c)
+          Row[x * 3 + c] = Src[x * 4 + c];
+      fwrite(Row.data(), 1, Row.size(), F);
+    }
+    return fclose(F) == 0;
+  }
+};
+
+#endif // OFFSCREENTARGET_H
@@ -0,0 +1,5 @@
+#include "Profiler.h"
+
+#ifdef PROFILER
+Profiler Profile;
+#endif
@@ -0,0 +1,273 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler. CPU time is measured with PROFILE_SCOPE, GPU time with
+// PROFILE_GPU_BEGIN/END pairs around GL commands. Nothing is recorded
+// until a capture is started, and without the PROFILER define all macros
+// compile to nothing.
+//
+// Captures are written in the Chrome trace event format, which can be
+// opened in chrome://tracing or https://ui.perfetto.dev. Every thread gets
+// a track of its own, the GPU one more, and the per-frame counters of
+// RenderStats are recorded as counter tracks.
+
+#ifdef PROFILER
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <fstream>
+#include "RenderStats.h"
+
+class Profiler {
+  typedef std::chrono::steady_clock Clock;
+
+  struct Event {
+    const char *Name;
+    int Thread;
+    // Microseconds since the start of the capture.
+    double Start;
+    double Duration;
+  };
+
+  struct CounterSample {
+    double Time;
+    RenderStats Counters;
+  };
+
+  // A GPU scope whose timestamps might not be available yet.
+  struct GpuQuery {
+    const char *Name;
+    GLuint Begin;
+    GLuint End;
+  };
+
+  // GPU events are recorded on a track after all threads.
+  static const int GpuThread = 1000;
+
+  std::atomic<bool> Capturing;
+  Clock::time_point CaptureStart;
+
+  std::mutex EventsMutex;
+  std::vector<Event> Events;
+  std::vector<CounterSample> Counters;
+  std::vector<std::pair<int, std::string>> ThreadNames;
+
+  // GPU timestamp that corresponds to CaptureStart, in nanoseconds.
+  GLint64 GpuStart = 0;
+  std::vector<GpuQuery> Pending;
+  std::vector<GpuQuery> Open;
+  std::vector<GLuint> FreeQueries;
+
+  static int threadId() {
+    static std::atomic<int> NextId(0);
+    thread_local int Id = NextId++;
+    return Id;
+  }
+
+  GLuint query() {
+    if (FreeQueries.empty()) {
+      FreeQueries.resize(64);
+      glGenQueries((GLsizei) FreeQueries.size(), FreeQueries.data());
+    }
+    GLuint Q = FreeQueries.back();
+    FreeQueries.pop_back();
+    return Q;
+  }
+
+  // Records the GPU scopes whose results arrived. Queries finish in order,
+  // so this stops at the first one still in flight.
+  void collectGpu(bool Wait) {
+    size_t done = 0;
+    for (; done < Pending.size(); ++done) {
+      GpuQuery &Q = Pending[done];
+      GLint Available = 0;
+      if (!Wait)
+        glGetQueryObjectiv(Q.End, GL_QUERY_RESULT_AVAILABLE, &Available);
+      if (!Wait && !Available)
+        break;
+      GLuint64 Begin, End;
+      glGetQueryObjectui64v(Q.Begin, GL_QUERY_RESULT, &Begin);
+      glGetQueryObjectui64v(Q.End, GL_QUERY_RESULT, &End);
+      FreeQueries.push_back(Q.Begin);
+      FreeQueries.push_back(Q.End);
+      std::lock_guard<std::mutex> Lock(EventsMutex);
+      Events.push_back({Q.Name, GpuThread, ((GLint64) Begin - GpuStart) / 1000.0,
+                        (End - Begin) / 1000.0});
+    }
+    Pending.erase(Pending.begin(), Pending.begin() + done);
+  }
+
+  static void writeString(std::ostream &Out, const std::string &S) {
+    Out << '"';
+    for (char c : S) {
+      if (c == '"' || c == '\\')
+        Out << '\\';
+      Out << c;
+    }
+    Out << '"';
+  }
+
+  void write(std::ostream &Out) {
+    Out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool First = true;
+    auto separate = [&]() {
+      if (!First)
+        Out << ",\n";
+      First = false;
+    };
+    for (auto &T : ThreadNames) {
+      separate();
+      Out << "{\"ph\": \"M\", \"pid\": 0, \"tid\": " << T.first
+          << ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+      writeString(Out, T.second);
+      Out << "}}";
+    }
+    separate();
+    Out << "{\"ph\": \"M\", \"pid\": 0, \"tid\": " << GpuThread
+        << ", \"name\": \"thread_name\", \"args\": {\"name\": \"GPU\"}}";
+    for (const Event &E : Events) {
+      separate();
+      Out << "{\"ph\": \"X\", \"pid\": 0, \"tid\": " << E.Thread << ", \"ts\": "
+          << E.Start << ", \"dur\": " << E.Duration << ", \"name\": ";
+      writeString(Out, E.Name);
+      Out << "}";
+    }
+    for (const CounterSample &C : Counters) {
+      const RenderStats &S = C.Counters;
+      separate();
+      Out << "{\"ph\": \"C\", \"pid\": 0, \"ts\": " << C.Time
+          << ", \"name\": \"draws\", \"args\": {\"draw calls\": " << S.DrawCalls
+          << ", \"state changes\": " << (S.StateChanges - S.SkippedStateChanges) << "}},\n";
+      Out << "{\"ph\": \"C\", \"pid\": 0, \"ts\": " << C.Time
+          << ", \"name\": \"triangles\", \"args\": {\"triangles\": " << S.Triangles << "}},\n";
+      Out << "{\"ph\": \"C\", \"pid\": 0, \"ts\": " << C.Time
+          << ", \"name\": \"sections\", \"args\": {\"traversed\": " << S.VisitedSections
+          << ", \"visible\": " << S.VisibleSections << "}},\n";
+      Out << "{\"ph\": \"C\", \"pid\": 0, \"ts\": " << C.Time
+          << ", \"name\": \"meshing\", \"args\": {\"remeshes\": " << S.Remeshes
+          << ", \"patches\": " << S.Patches << ", \"light updates\": "
+          << S.LightUpdates << "}}";
+    }
+    Out << "\n]}\n";
+  }
+
+public:
+  Profiler() : Capturing(false) {
+  }
+
+  bool capturing() const {
+    return Capturing.load(std::memory_order_acquire);
+  }
+
+  // Microseconds since the start of the capture.
+  double now() const {
+    return std::chrono::duration<double, std::micro>(Clock::now() - CaptureStart).count();
+  }
+
+  // Names the track of the calling thread.
+  void setThreadName(const std::string &Name) {
+    std::lock_guard<std::mutex> Lock(EventsMutex);
+    ThreadNames.emplace_back(threadId(), Name);
+  }
+
+  void addEvent(const char *Name, double Start, double End) {
+    std::lock_guard<std::mutex> Lock(EventsMutex);
+    Events.push_back({Name, threadId(), Start, End - Start});
+  }
+
+  // Has to be called between frames, on the thread with the GL context.
+  void startCapture() {
+    std::lock_guard<std::mutex> Lock(EventsMutex);
+    Events.clear();
+    Counters.clear();
+    CaptureStart = Clock::now();
+    glGetInteger64v(GL_TIMESTAMP, &GpuStart);
+    Capturing = true;
+  }
+
+  // Waits for the outstanding GPU scopes and writes the capture to the
+  // given file. Has to be called between frames. Returns false if the file
+  // couldn't be written.
+  bool stopCapture(const std::string &Path) {
+    Capturing = false;
+    collectGpu(true);
+    std::ofstream Out(Path);
+    std::lock_guard<std::mutex> Lock(EventsMutex);
+    write(Out);
+    Events.clear();
+    Counters.clear();
+    return (bool) Out;
+  }
+
+  // GPU scopes can be nested but have to be closed on the same thread and
+  // in the same frame.
+  void beginGpu(const char *Name) {
+    if (!capturing())
+      return;
+    GpuQuery Q = {Name, query(), query()};
+    glQueryCounter(Q.Begin, GL_TIMESTAMP);
+    Open.push_back(Q);
+  }
+
+  void endGpu() {
+    if (Open.empty())
+      return;
+    GpuQuery Q = Open.back();
+    Open.pop_back();
+    glQueryCounter(Q.End, GL_TIMESTAMP);
+    Pending.push_back(Q);
+  }
+
+  // Records the counters of the frame and picks up finished GPU scopes.
+  void endFrame() {
+    if (!capturing())
+      return;
+    collectGpu(false);
+    std::lock_guard<std::mutex> Lock(EventsMutex);
+    Counters.push_back({now(), Stats});
+  }
+};
+
+extern Profiler Profile;
+
+// Records the time until the end of the enclosing block.
+class ProfileScope {
+  const char *Name;
+  double Start;
+
+public:
+  explicit ProfileScope(const char *Name) : Name(Name), Start(-1) {
+    if (Profile.capturing())
+      Start = Profile.now();
+  }
+
+  ~ProfileScope() {
+    if (Start >= 0 && Profile.capturing())
+      Profile.addEvent(Name, Start, Profile.now());
+  }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(Name) ProfileScope PROFILE_CONCAT(ProfileScope_, __LINE__)(Name)
+#define PROFILE_GPU_BEGIN(Name) Profile.beginGpu(Name)
+#define PROFILE_GPU_END() Profile.endGpu()
+#define PROFILE_THREAD(Name) Profile.setThreadName(Name)
+#define PROFILE_FRAME_END() Profile.endFrame()
+
+#else
+
+// The arguments are only referenced, never evaluated.
+#define PROFILE_SCOPE(Name)
+#define PROFILE_GPU_BEGIN(Name) ((void) sizeof(Name))
+#define PROFILE_GPU_END() ((void) 0)
+#define PROFILE_THREAD(Name) ((void) sizeof(Name))
+#define PROFILE_FRAME_END() ((void) 0)
+
+#endif // PROFILER
+
+#endif // PROFILER_H
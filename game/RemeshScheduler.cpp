@@ -0,0 +1 @@
+#include "RemeshScheduler.h"
@@ -0,0 +1,114 @@
+#ifndef REMESHSCHEDULER_H
+#define REMESHSCHEDULER_H
+
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include "VoxelMapRenderer.h"
+#include "RenderView.h"
+#include "RenderStats.h"
+#include "Profiler.h"
+
+// Collects sections that need to be remeshed or need coarser levels built
+// and builds them over the following frames. Each frame only spends a
+// fixed time budget on meshing and uploading, starting with visible
+// sections closest to the camera.
+//
+// Building reads voxels, so run() has to be called with the world mutex
+// held.
+class RemeshScheduler {
+
+  std::unordered_set<VoxelMapRenderer *> Dirty;
+  // Parts of coarser levels to build, see VoxelMapRenderer::missing().
+  std::unordered_map<VoxelMapRenderer *, uint8_t> LevelBuilds;
+
+  float BudgetMillis;
+
+  struct Job {
+    float Priority;
+    VoxelMapRenderer *R;
+    // Levels to build, or 0 to remesh.
+    uint8_t Parts;
+  };
+  // Sections in the frustum are sorted before all others, closer ones first.
+  // Remeshing a section comes before building its levels.
+  std::vector<Job> Queue;
+
+public:
+  RemeshScheduler(float BudgetMillis = 4) : BudgetMillis(BudgetMillis) {
+  }
+
+  void setBudget(float Millis) {
+    BudgetMillis = Millis;
+  }
+
+  float getBudget() const {
+    return BudgetMillis;
+  }
+
+  void schedule(VoxelMapRenderer *R) {
+    Dirty.insert(R);
+  }
+
+  // Queues building the given parts of the coarser levels of a section.
+  void scheduleLevels(VoxelMapRenderer *R, uint8_t Parts) {
+    LevelBuilds[R] |= Parts;
+  }
+
+  size_t size() const {
+    return Dirty.size() + LevelBuilds.size();
+  }
+
+  // Remeshes sections and builds levels until the budget is used up. At
+  // least one job is handled per call so the queue always drains.
+  void run(const RenderView &View) {
+    Stats.RemeshQueue = size();
+    if (!size())
+      return;
+    PROFILE_SCOPE("remesh");
+
+    const float sectionSize = VoxelMapRenderer::getSize();
+    auto priorityOf = [&](VoxelMapRenderer *R) {
+      const v3 &o = R->getOffset();
+      glm::vec3 min(o.x, o.y, o.z);
+      glm::vec3 max = min + glm::vec3(sectionSize);
+      float priority = View.distanceSquared(min, max);
+      if (!View.frustum.intersects(min, max))
+        priority += 1e12f;
+      return priority;
+    };
+    Queue.clear();
+    for (VoxelMapRenderer *R : Dirty)
+      Queue.push_back({priorityOf(R), R, 0});
+    for (auto &Entry : LevelBuilds)
+      Queue.push_back({priorityOf(Entry.first), Entry.first, Entry.second});
+    std::sort(Queue.begin(), Queue.end(), [](const Job &A, const Job &B) {
+      if (A.Priority != B.Priority)
+        return A.Priority < B.Priority;
+      return A.Parts < B.Parts;
+    });
+
+    typedef std::chrono::steady_clock Clock;
+    auto Start = Clock::now();
+    float elapsed = 0;
+    for (const Job &J : Queue) {
+      if (Stats.Remeshes + Stats.LodBuilds > 0 && elapsed >= BudgetMillis)
+        break;
+      if (J.Parts) {
+        J.R->build(J.Parts);
+        LevelBuilds.erase(J.R);
+        ++Stats.LodBuilds;
+      } else {
+        J.R->recreate();
+        Dirty.erase(J.R);
+        ++Stats.Remeshes;
+      }
+      elapsed = std::chrono::duration<float, std::milli>(Clock::now() - Start).count();
+    }
+    Stats.RemeshMillis = elapsed;
+  }
+};
+
+#endif // REMESHSCHEDULER_H
@@ -0,0 +1 @@
+#include "RenderQueue.h"
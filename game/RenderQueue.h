@@ -0,0 +1,208 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include "GeometryArena.h"
+#include "GLState.h"
+#include "RenderStats.h"
+#include "Profiler.h"
+
+// Collects the draws of a frame and issues them sorted by pass, program,
+// texture and depth, so every program and texture is only bound once per
+// pass no matter how many renderers submit draws.
+//
+// Draws of ranges inside a GeometryArena that end up next to each other
+// with the same state are merged into a single glMultiDrawArrays call.
+class RenderQueue {
+public:
+  // Passes are drawn in this order. Draws of the background pass may be
+  // blended, so they are sorted back to front, all others front to back.
+  enum Pass {
+    OPAQUE_PASS,
+    CUTOUT_PASS,
+    BACKGROUND_PASS
+  };
+
+private:
+  struct Command {
+    uint64_t Key;
+    Pass P;
+    GLuint Program;
+    unsigned Texture;
+    // Draws ranges of the arena after calling Bind, if set. Otherwise Draw
+    // does everything.
+    GeometryArena *Arena;
+    size_t FirstRange;
+    size_t RangeCount;
+    std::function<void()> Bind;
+    std::function<void()> Draw;
+
+    // Whether both commands draw from the same arena with the same state.
+    bool mergesWith(const Command &O) const {
+      return Arena && Arena == O.Arena && P == O.P && Program == O.Program &&
+             Texture == O.Texture;
+    }
+  };
+
+  std::vector<Command> Commands;
+  std::vector<GLint> Firsts;
+  std::vector<GLsizei> Counts;
+
+  // Sets the uniforms of a program for the current frame.
+  std::unordered_map<GLuint, std::function<void()>> ProgramSetups;
+
+  // Ranges of the merged draw that is issued next.
+  std::vector<GLint> DrawFirsts;
+  std::vector<GLsizei> DrawCounts;
+
+  // Pass in the highest 8 bits, followed by 16 bits each of program and
+  // texture, and the distance to the camera in the lowest 24 bits. In the
+  // background pass the distance comes first, inverted.
+  static uint64_t key(Pass P, GLuint Program, unsigned Texture, float Depth) {
+    const uint64_t MaxDepth = (1 << 24) - 1;
+    const uint64_t D = (uint64_t) std::min<float>(MaxDepth, std::max(0.0f, Depth));
+    const uint64_t State = ((uint64_t) (Program & 0xFFFF) << 16) | (Texture & 0xFFFF);
+    if (P == BACKGROUND_PASS)
+      return ((uint64_t) P << 56) | ((MaxDepth - D) << 32) | State;
+    return ((uint64_t) P << 56) | (State << 24) | D;
+  }
+
+  Command &add(Pass P, GLuint Program, unsigned Texture, float Depth) {
+    Commands.emplace_back();
+    Command &C = Commands.back();
+    C.Key = key(P, Program, Texture, Depth);
+    C.P = P;
+    C.Program = Program;
+    C.Texture = Texture;
+    C.Arena = nullptr;
+    C.FirstRange = Firsts.size();
+    C.RangeCount = 0;
+    return C;
+  }
+
+  static void appendRange(std::vector<GLint> &F, std::vector<GLsizei> &C,
+                          GLint first, GLsizei count) {
+    if (!F.empty() && F.back() + C.back() == first) {
+      C.back() += count;
+      return;
+    }
+    F.push_back(first);
+    C.push_back(count);
+  }
+
+public:
+  // Sets the function that sets the uniforms of the given program. It's
+  // called once per flush(), when the program is first used.
+  void setProgramSetup(GLuint Program, std::function<void()> Setup) {
+    ProgramSetups[Program] = std::move(Setup);
+  }
+
+  // Submits a draw that binds everything but the program itself. Texture
+  // identifies the textures it binds, draws with equal textures are grouped.
+  // Depth is the distance to the camera.
+  void submit(Pass P, GLuint Program, unsigned Texture, float Depth,
+              std::function<void()> Draw) {
+    add(P, Program, Texture, Depth).Draw = std::move(Draw);
+  }
+
+  // Submits a draw of ranges inside the arena, which are added with
+  // addRange() afterwards. Bind has to bind the textures identified by
+  // Texture, it's only called once for merged draws.
+  void submitArena(Pass P, GLuint Program, unsigned Texture, float Depth,
+                   GeometryArena &Arena, std::function<void()> Bind) {
+    Command &C = add(P, Program, Texture, Depth);
+    C.Arena = &Arena;
+    C.Bind = std::move(Bind);
+  }
+
+  // Adds a range to the last submitArena() call.
+  void addRange(const ArenaRange &Range) {
+    assert(!Commands.empty() && Commands.back().Arena);
+    if (Range.empty())
+      return;
+    Command &C = Commands.back();
+    const size_t Before = Firsts.size();
+    // Ranges can only be joined within the same command.
+    if (C.RangeCount == 0) {
+      Firsts.push_back(Range.first);
+      Counts.push_back(Range.count);
+    } else {
+      appendRange(Firsts, Counts, Range.first, Range.count);
+    }
+    C.RangeCount += Firsts.size() - Before;
+  }
+
+  // Issues all submitted draws and empties the queue.
+  void flush() {
+    PROFILE_SCOPE("flush");
+    std::stable_sort(Commands.begin(), Commands.end(),
+                     [](const Command &A, const Command &B) {
+                       return A.Key < B.Key;
+                     });
+
+    // Every pass is timed on the GPU.
+    static const char *PassNames[] = {"opaque pass", "cutout pass", "background pass"};
+    int CurrentPass = -1;
+
+    std::vector<GLuint> SetUp;
+    for (size_t i = 0; i < Commands.size();) {
+      Command &C = Commands[i];
+      if (C.P != CurrentPass) {
+        if (CurrentPass >= 0)
+          PROFILE_GPU_END();
+        CurrentPass = C.P;
+        PROFILE_GPU_BEGIN(PassNames[CurrentPass]);
+      }
+      size_t end = i + 1;
+      if (C.Arena) {
+        DrawFirsts.clear();
+        DrawCounts.clear();
+        unsigned Merged = 0;
+        for (end = i; end < Commands.size() && C.mergesWith(Commands[end]); ++end) {
+          const Command &M = Commands[end];
+          for (size_t r = M.FirstRange; r < M.FirstRange + M.RangeCount; ++r)
+            appendRange(DrawFirsts, DrawCounts, Firsts[r], Counts[r]);
+          Merged += M.RangeCount != 0;
+        }
+        if (DrawFirsts.empty()) {
+          i = end;
+          continue;
+        }
+        Stats.MergedDraws += Merged - 1;
+      }
+
+      GLState.useProgram(C.Program);
+      if (std::find(SetUp.begin(), SetUp.end(), C.Program) == SetUp.end()) {
+        SetUp.push_back(C.Program);
+        auto Setup = ProgramSetups.find(C.Program);
+        if (Setup != ProgramSetups.end())
+          Setup->second();
+      }
+
+      ++Stats.DrawCalls;
+      if (C.Arena) {
+        if (C.Bind)
+          C.Bind();
+        C.Arena->draw(DrawFirsts, DrawCounts);
+      } else {
+        C.Draw();
+      }
+      i = end;
+    }
+    if (CurrentPass >= 0)
+      PROFILE_GPU_END();
+
+    Commands.clear();
+    Firsts.clear();
+    Counts.clear();
+    ProgramSetups.clear();
+  }
+};
+
+#endif // RENDERQUEUE_H
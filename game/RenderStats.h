@@ -0,0 +1,58 @@
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <ostream>
+
+// Per-frame rendering counters. Reset at the start of every frame.
+class RenderStats {
+public:
+  unsigned Sections = 0;
+  unsigned NonEmptySections = 0;
+  unsigned VisibleSections = 0;
+  unsigned DrawCalls = 0;
+  unsigned MergedDraws = 0;
+  unsigned Triangles = 0;
+  unsigned VisitedSections = 0;
+  unsigned OccludedSections = 0;
+  float OcclusionMillis = 0;
+  unsigned RemeshQueue = 0;
+  unsigned Remeshes = 0;
+  float RemeshMillis = 0;
+  unsigned LodSections = 0;
+  unsigned LodBuilds = 0;
+  unsigned Patches = 0;
+  float PatchMillis = 0;
+  unsigned LightUpdates = 0;
+  float LightMillis = 0;
+  unsigned DynamicLights = 0;
+  unsigned LightIndices = 0;
+  float ClusterMillis = 0;
+  unsigned StateChanges = 0;
+  unsigned SkippedStateChanges = 0;
+
+  void reset() {
+    *this = RenderStats();
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const RenderStats &S) {
+    return os << "sections: " << S.VisibleSections << " visible of "
+              << S.NonEmptySections << " non-empty (" << S.Sections
+              << " total, " << S.VisitedSections << " traversed, "
+              << S.OccludedSections << " occluded in " << S.OcclusionMillis << " ms), "
+              << S.LodSections << " at lower detail (" << S.LodBuilds << " built), "
+              << S.DrawCalls << " draw calls ("
+              << S.MergedDraws << " merged away), " << S.Triangles << " triangles, "
+              << S.Remeshes << " of " << S.RemeshQueue << " queued remeshes in "
+              << S.RemeshMillis << " ms, " << S.Patches << " patched in "
+              << S.PatchMillis << " ms, " << S.LightUpdates
+              << " light updates in " << S.LightMillis << " ms, "
+              << S.DynamicLights << " dynamic lights (" << S.LightIndices
+              << " cluster entries in " << S.ClusterMillis << " ms), "
+              << S.SkippedStateChanges << " of " << S.StateChanges
+              << " state changes skipped";
+  }
+};
+
+extern RenderStats Stats;
+
+#endif // RENDERSTATS_H
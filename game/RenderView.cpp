@@ -0,0 +1 @@
+#include "RenderView.h"
@@ -0,0 +1,40 @@
+#ifndef RENDERVIEW_H
+#define RENDERVIEW_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include "Frustum.h"
+
+class OcclusionBuffer;
+
+// Everything a renderer needs to know about the camera for one frame.
+struct RenderView {
+  glm::mat4 MVP;
+  glm::vec3 cameraPos;
+  Frustum frustum;
+  // Optional software depth buffer with this frame's occluders.
+  const OcclusionBuffer *occlusion = nullptr;
+  // Height of the viewport in pixels.
+  float screenHeight = 720;
+
+  RenderView(const glm::mat4 &MVP, const glm::vec3 &cameraPos)
+    : MVP(MVP), cameraPos(cameraPos), frustum(MVP) {
+  }
+
+  // Squared distance from the camera to the closest point of the box.
+  float distanceSquared(const glm::vec3 &min, const glm::vec3 &max) const {
+    glm::vec3 closest = glm::clamp(cameraPos, min, max);
+    glm::vec3 diff = closest - cameraPos;
+    return glm::dot(diff, diff);
+  }
+
+  // Approximate height in pixels of something of the given size at the
+  // given distance. The view is rigid, so the length of the second row of
+  // the MVP matrix is the vertical scale of the projection.
+  float projectedSize(float size, float distance) const {
+    const float scale = glm::length(glm::vec3(MVP[0][1], MVP[1][1], MVP[2][1]));
+    return size * scale * screenHeight * 0.5f / std::max(distance, 0.001f);
+  }
+};
+
+#endif // RENDERVIEW_H
@@ -17,7 +17,11 @@ class RenderWindow {
   //OpenGL context
   SDL_GLContext Context;
 
+  // Size of the default framebuffer. Fullscreen windows get the size of the
+  // display instead of the requested one.
   int Width, Height;
+  // Hidden windows only provide a GL context for offscreen rendering.
+  bool Hidden;
 
   void close() {
     //Destroy window
@@ -32,7 +36,7 @@ class RenderWindow {
 
 
 public:
-  RenderWindow(int w, int h) : Width(w), Height(h) {
+  RenderWindow(int w, int h, bool Hidden = false) : Width(w), Height(h), Hidden(Hidden) {
     if (!init()) {
       std::cerr << "Init failure" << std::endl;
       exit(1);
@@ -69,7 +73,8 @@ public:
       //Create window
       Window = SDL_CreateWindow("SDL Tutorial", SDL_WINDOWPOS_UNDEFINED,
                                 SDL_WINDOWPOS_UNDEFINED, Width, Height,
-                                SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_FULLSCREEN_DESKTOP);
+                                SDL_WINDOW_OPENGL | (Hidden ? SDL_WINDOW_HIDDEN :
+                                  SDL_WINDOW_SHOWN | SDL_WINDOW_FULLSCREEN_DESKTOP));
       if (Window == NULL) {
         printf("Window could not be created! SDL Error: %s\n", SDL_GetError());
         success = false;
@@ -94,9 +99,11 @@ public:
             printf("Unable to initialize OpenGL!\n");
             success = false;
           }
+          SDL_GL_GetDrawableSize(Window, &Width, &Height);
         }
         // Grab the mouse
-        SDL_SetRelativeMouseMode(SDL_TRUE);
+        if (!Hidden)
+          SDL_SetRelativeMouseMode(SDL_TRUE);
       }
     }
 
@@ -131,6 +138,14 @@ public:
     SDL_GL_SwapWindow(Window);
   }
 
+  int getWidth() const {
+    return Width;
+  }
+
+  int getHeight() const {
+    return Height;
+  }
+
 };
 
 
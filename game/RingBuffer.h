@@ -0,0 +1,53 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+// A fixed-size queue between exactly one producer and one consumer thread.
+// Neither side ever blocks or allocates: push() fails if the queue is full
+// and pop() if it's empty.
+template<typename T, size_t Size>
+class RingBuffer {
+  static_assert(Size != 0 && (Size & (Size - 1)) == 0, "size has to be a power of two");
+
+  T Items[Size];
+  // Both only ever grow, the slot is the index modulo Size. Head is only
+  // written by the producer, Tail only by the consumer.
+  std::atomic<size_t> Head;
+  std::atomic<size_t> Tail;
+
+public:
+  RingBuffer() : Head(0), Tail(0) {
+  }
+
+  RingBuffer(const RingBuffer &) = delete;
+  RingBuffer &operator=(const RingBuffer &) = delete;
+
+  // Called by the producer.
+  bool push(const T &Item) {
+    const size_t H = Head.load(std::memory_order_relaxed);
+    if (H - Tail.load(std::memory_order_acquire) == Size)
+      return false;
+    Items[H % Size] = Item;
+    Head.store(H + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer.
+  bool pop(T &Item) {
+    const size_t Next = Tail.load(std::memory_order_relaxed);
+    if (Next == Head.load(std::memory_order_acquire))
+      return false;
+    Item = Items[Next % Size];
+    Tail.store(Next + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Only a snapshot if the other thread is active.
+  size_t size() const {
+    return Head.load(std::memory_order_acquire) - Tail.load(std::memory_order_acquire);
+  }
+};
+
+#endif // RINGBUFFER_H
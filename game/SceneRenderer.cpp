@@ -0,0 +1 @@
+#include "SceneRenderer.h"
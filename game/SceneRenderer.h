@@ -0,0 +1,237 @@
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <common/shader.hpp>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "World.h"
+#include "GLState.h"
+#include "GeometryArena.h"
+#include "LightAtlas.h"
+#include "RemeshScheduler.h"
+#include "VoxelRenderMap.h"
+#include "RenderQueue.h"
+#include "RenderView.h"
+#include "RenderStats.h"
+#include "DeepSpaceRenderer.h"
+#include "SkyBox.h"
+#include "OcclusionBuffer.h"
+#include "DynamicLights.h"
+#include "Profiler.h"
+
+// Draws the world as seen from a camera: the blocks of the ship and the
+// meteor, lit by dynamic point lights, in front of the deep space
+// background. Owns every program and GPU resource this needs and keeps the
+// block meshes in sync with the changes of the simulation.
+//
+// Needs a current GL context for its whole lifetime.
+class SceneRenderer {
+  World &W;
+
+  GLuint BlockProgramID;
+  GLuint MatrixID;
+  // Same shaders, but discarding magenta texels for blocks like glass.
+  GLuint BlockCutoutProgramID;
+  GLuint CutoutMatrixID;
+  GLuint SpaceProgramID;
+  GLuint SpaceMatrixID;
+  // Stars are expanded from one instance each in the vertex shader.
+  GLuint StarProgramID;
+  GLuint StarMatrixID;
+  GLuint SkyProgramID;
+  GLuint SkyMatrixID;
+
+  GeometryArena BlockArena;
+  LightAtlas BlockLights;
+  RemeshScheduler Remesher;
+
+  VoxelRenderMap ShipRenderer;
+  VoxelRenderMap MeteorRenderer;
+
+  RenderQueue Queue;
+
+  // Only exists while the background is drawn as geometry.
+  std::unique_ptr<DeepSpaceRenderer> DeepSpace;
+  SkyBox Sky;
+
+  OcclusionBuffer Occlusion;
+  DynamicLights PointLights;
+
+  void submitDeepSpace(const glm::mat4 &MVP) {
+    Queue.setProgramSetup(StarProgramID, [this, MVP]() {
+      glUniformMatrix4fv(StarMatrixID, 1, GL_FALSE, &MVP[0][0]);
+    });
+    Queue.setProgramSetup(SpaceProgramID, [this, MVP]() {
+      glUniformMatrix4fv(SpaceMatrixID, 1, GL_FALSE, &MVP[0][0]);
+    });
+    Queue.submit(RenderQueue::BACKGROUND_PASS, StarProgramID, 0,
+                 DeepSpaceRenderer::StarDistance, [this]() { DeepSpace->drawStars(); });
+    Queue.submit(RenderQueue::BACKGROUND_PASS, SpaceProgramID, 0,
+                 DeepSpaceRenderer::PlanetDistance, [this]() { DeepSpace->draw(); });
+  }
+
+  // Patches the blocks the simulation changed and spends the remeshing
+  // budget of this frame.
+  void updateWorld(const RenderView &View) {
+    PROFILE_SCOPE("world changes");
+    std::lock_guard<std::mutex> Lock(W.Sim.getWorldMutex());
+    for (const v3 &Pos : W.Sim.takeChangedBlocks()) {
+      ShipRenderer.patchBlock(Pos);
+      MeteorRenderer.patchBlock(Pos);
+    }
+    for (const auto &Box : W.Sim.takeChangedBoxes()) {
+      ShipRenderer.recreateBox(Box.first, Box.second);
+      MeteorRenderer.recreateBox(Box.first, Box.second);
+    }
+    ShipRenderer.updateLight();
+    MeteorRenderer.updateLight();
+    if (Remesher.size())
+      Remesher.run(View);
+  }
+
+public:
+  // Unless LiveSky is set, the background is rendered once into a cube map,
+  // which is cached in a file in the working directory.
+  SceneRenderer(World &W, bool LiveSky)
+    : W(W), ShipRenderer(W.Ship, BlockArena, BlockLights, Remesher),
+      MeteorRenderer(W.Meteor, BlockArena, BlockLights, Remesher) {
+    glClearColor(0.00f, 0.00f, 0.00f, 1.0f);
+
+    // Accept fragment if it closer to the camera than the former one
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Cull triangles which normal is not towards the camera
+    glEnable(GL_CULL_FACE);
+
+    // Block shaders are compiled with dynamic point lights.
+    const std::string BlockDefines = DynamicLights::getShaderDefines();
+    BlockProgramID = LoadShaders("BlockVertexShader.vert", "BlockFragmentShader.frag",
+                                 BlockDefines.c_str());
+    MatrixID = glGetUniformLocation(BlockProgramID, "MVP");
+    BlockCutoutProgramID = LoadShaders("BlockVertexShader.vert", "BlockFragmentShader.frag",
+                                       (BlockDefines + "#define CUTOUT\n").c_str());
+    CutoutMatrixID = glGetUniformLocation(BlockCutoutProgramID, "MVP");
+
+    // The light atlas has a texture unit of its own.
+    for (GLuint ProgramID : {BlockProgramID, BlockCutoutProgramID}) {
+      GLState.useProgram(ProgramID);
+      GLState.setSampler(glGetUniformLocation(ProgramID, "lightAtlas"), LightAtlas::Unit);
+    }
+
+    SpaceProgramID = LoadShaders("DeepSpaceVertexShader.vert", "DeepSpaceFragmentShader.frag");
+    SpaceMatrixID = glGetUniformLocation(SpaceProgramID, "MVP");
+    StarProgramID = LoadShaders("StarVertexShader.vert", "DeepSpaceFragmentShader.frag");
+    StarMatrixID = glGetUniformLocation(StarProgramID, "MVP");
+    SkyProgramID = LoadShaders("SkyVertexShader.vert", "SkyFragmentShader.frag");
+    SkyMatrixID = glGetUniformLocation(SkyProgramID, "inverseViewProjection");
+
+    // The background is far enough away to not move relative to the camera,
+    // so it's rendered once into a cube map.
+    if (LiveSky) {
+      DeepSpace.reset(new DeepSpaceRenderer());
+    } else {
+      const std::string SkyCache = "deepspace-" + DeepSpaceRenderer::cacheKey() + "-" +
+                                   std::to_string(Sky.getFaceSize()) + ".sky";
+      if (!Sky.load(SkyCache)) {
+        DeepSpace.reset(new DeepSpaceRenderer());
+        Sky.bake([this](const glm::mat4 &MVP) {
+          submitDeepSpace(MVP);
+          Queue.flush();
+        });
+        DeepSpace.reset();
+        if (!Sky.save(SkyCache))
+          std::cerr << "Couldn't write " << SkyCache << std::endl;
+      }
+    }
+  }
+
+  ~SceneRenderer() {
+    GLState.deleteProgram(BlockProgramID);
+    GLState.deleteProgram(BlockCutoutProgramID);
+    GLState.deleteProgram(SpaceProgramID);
+    GLState.deleteProgram(StarProgramID);
+    GLState.deleteProgram(SkyProgramID);
+  }
+
+  SceneRenderer(const SceneRenderer &) = delete;
+  SceneRenderer &operator=(const SceneRenderer &) = delete;
+
+  RemeshScheduler &getRemesher() {
+    return Remesher;
+  }
+
+  // Clears the bound framebuffer and draws the scene into its current
+  // viewport. The camera carries a light around.
+  void render(const glm::mat4 &Projection, const glm::mat4 &ViewMatrix,
+              const glm::vec3 &CameraPos) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    const glm::mat4 MVP = Projection * ViewMatrix;
+    RenderView View(MVP, CameraPos);
+    // The viewport is the size of the framebuffer in pixels, which can be
+    // larger than the window on high DPI displays.
+    GLint Viewport[4];
+    glGetIntegerv(GL_VIEWPORT, Viewport);
+    View.screenHeight = Viewport[3];
+    PointLights.setScreenSize(Viewport[2], Viewport[3]);
+
+    PointLights.clear();
+    PointLights.add(PointLight(CameraPos, 12, glm::vec3(0.9f, 0.8f, 0.6f)));
+    PointLights.update(View);
+
+    // Blocks changed by the simulation are patched right before drawing.
+    updateWorld(View);
+
+    Occlusion.begin(MVP);
+    ShipRenderer.addOccluders(View, Occlusion);
+    MeteorRenderer.addOccluders(View, Occlusion);
+    Occlusion.rasterize();
+    Stats.OcclusionMillis = Occlusion.getMillis();
+    View.occlusion = &Occlusion;
+
+    ShipRenderer.cull(View);
+    MeteorRenderer.cull(View);
+
+    PROFILE_SCOPE("draw");
+    // Send our transformation to the block shaders, in the "MVP" uniform,
+    // once they are used.
+    Queue.setProgramSetup(BlockProgramID, [&]() {
+      glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+      PointLights.bind(BlockProgramID);
+    });
+    Queue.setProgramSetup(BlockCutoutProgramID, [&]() {
+      glUniformMatrix4fv(CutoutMatrixID, 1, GL_FALSE, &MVP[0][0]);
+      PointLights.bind(BlockCutoutProgramID);
+    });
+
+    for (VoxelRenderMap *R : {&ShipRenderer, &MeteorRenderer}) {
+      R->submit(View, BlockSideArray::OPAQUE_PASS, BlockProgramID, Queue);
+      R->submit(View, BlockSideArray::CUTOUT_PASS, BlockCutoutProgramID, Queue);
+    }
+
+    if (DeepSpace) {
+      submitDeepSpace(MVP);
+    } else {
+      glm::mat4 SkyMatrix = glm::inverse(Projection * glm::mat4(glm::mat3(ViewMatrix)));
+      Queue.setProgramSetup(SkyProgramID, [&]() {
+        glUniformMatrix4fv(SkyMatrixID, 1, GL_FALSE, &SkyMatrix[0][0]);
+      });
+      // Lies behind everything else.
+      Queue.submit(RenderQueue::BACKGROUND_PASS, SkyProgramID, 0,
+                   std::numeric_limits<float>::max(), [this]() { Sky.draw(); });
+    }
+
+    Queue.flush();
+  }
+};
+
+#endif // SCENERENDERER_H
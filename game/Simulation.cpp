@@ -0,0 +1 @@
+#include "Simulation.h"
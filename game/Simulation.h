@@ -0,0 +1,323 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Map.h"
+#include "MovingEntity.h"
+#include "Profiler.h"
+#include "RingBuffer.h"
+#include "VoxelEdit.h"
+
+// Everything the simulation needs to know about the player's input. The
+// render thread overwrites the movement values every frame, while the
+// one-shot actions stay set until the simulation consumed them.
+struct PlayerInput {
+  float horizAngle = 0;
+  float x = 0, y = 0, z = 0;
+  glm::vec3 direction = glm::vec3(0, 0, 1);
+  Voxel::Types blockType = Voxel::CRATE;
+
+  bool jump = false;
+  bool breakBlock = false;
+  bool placeBlock = false;
+};
+
+// State handed from the simulation to the renderer after every tick.
+struct SimSnapshot {
+  v3f playerPos = v3f(0, 0, 0);
+  uint64_t tick = 0;
+  std::chrono::steady_clock::time_point time;
+};
+
+// Runs the world simulation with a fixed tick on its own thread. The
+// renderer only sees the last two published snapshots and interpolates
+// between them, so a slow tick no longer stalls a frame and vice versa.
+class Simulation {
+  Space &space;
+  MovingEntity &Player;
+  // Edits apply to all of them. The first one is the ship, which is the
+  // only chunk updated every tick, like the game always did.
+  std::vector<VoxelChunk *> Chunks;
+
+  const float TickLength;
+
+  std::thread Thread;
+  std::atomic<bool> Running;
+
+  std::mutex WorldMutex;
+
+  std::mutex InputMutex;
+  PlayerInput Input;
+
+  std::mutex SnapshotMutex;
+  SimSnapshot Previous;
+  SimSnapshot Current;
+  std::vector<v3> ChangedBlocks;
+  // Boxes changed by edits since the renderer last asked.
+  std::vector<std::pair<v3, v3>> ChangedBoxes;
+  // Edits applied by the next tick, guarded by InputMutex.
+  std::vector<VoxelEdit> PendingEdits;
+  // The input every tick consumed, if recording.
+  bool RecordInputs = false;
+  std::vector<PlayerInput> TickInputs;
+
+  // Durations of the ticks the renderer hasn't picked up yet.
+  RingBuffer<float, 256> TickTimes;
+  uint64_t Ticks = 0;
+
+  PlayerInput takeInput() {
+    std::lock_guard<std::mutex> Lock(InputMutex);
+    PlayerInput Result = Input;
+    Input.jump = Input.breakBlock = Input.placeBlock = false;
+    return Result;
+  }
+
+  void breakBlock(const v3f &eye, const glm::vec3 &direction, std::vector<v3> &Changed) {
+    for (int i = 0; i < 20; ++i) {
+      glm::vec3 testPos = glm::vec3(eye.x, eye.y, eye.z) + direction * (i / 4.0f);
+
+      v3 voxel((int64_t) testPos.x, (int64_t) testPos.y, (int64_t) testPos.z);
+
+      if (!space.get(voxel).isBuildable())
+        continue;
+
+      space.getChunk(voxel)->setBlock(voxel, Voxel::AIR);
+      Changed.push_back(voxel);
+      break;
+    }
+  }
+
+  void placeBlock(const v3f &eye, const glm::vec3 &direction, Voxel::Types Type,
+                  std::vector<v3> &Changed) {
+    const glm::vec3 start(eye.x, eye.y, eye.z);
+    glm::vec3 lastFreePos = start;
+    for (int i = 0; i < 20; ++i) {
+      glm::vec3 testPos = start + direction * (i / 4.0f);
+
+      v3 voxel((int64_t) testPos.x, (int64_t) testPos.y, (int64_t) testPos.z);
+
+      if (!space.get(voxel).isBuildable()) {
+        lastFreePos = testPos;
+        continue;
+      }
+
+      if (lastFreePos != start) {
+        v3 lastFreeVoxel((int64_t) lastFreePos.x, (int64_t) lastFreePos.y,
+                         (int64_t) lastFreePos.z);
+        if (auto C = space.getChunk(lastFreeVoxel)) {
+          if (!space.isOccupied(lastFreeVoxel)) {
+            C->setBlock(lastFreeVoxel, Type);
+            Changed.push_back(lastFreeVoxel);
+          }
+        }
+      }
+      break;
+    }
+  }
+
+  void tick() {
+    PROFILE_SCOPE("tick");
+    PlayerInput In = takeInput();
+    std::vector<VoxelEdit> Edits;
+    {
+      std::lock_guard<std::mutex> Lock(InputMutex);
+      Edits.swap(PendingEdits);
+    }
+    std::vector<v3> Changed;
+    std::vector<std::pair<v3, v3>> Boxes;
+
+    {
+      std::lock_guard<std::mutex> Lock(WorldMutex);
+
+      if (In.jump)
+        if (Player.onGround())
+          Player.jump();
+      Player.setMove(In.horizAngle, In.x, In.y, In.z);
+      {
+        PROFILE_SCOPE("physics");
+        Player.update(TickLength);
+        Chunks.front()->update(TickLength);
+      }
+
+      if (In.breakBlock)
+        breakBlock(Player.position(), In.direction, Changed);
+      if (In.placeBlock)
+        placeBlock(Player.position(), In.direction, In.blockType, Changed);
+
+      for (const VoxelEdit &E : Edits)
+        for (VoxelChunk *C : Chunks) {
+          auto ChunkBoxes = C->apply(E);
+          Boxes.insert(Boxes.end(), ChunkBoxes.begin(), ChunkBoxes.end());
+        }
+    }
+
+    ++Ticks;
+
+    std::lock_guard<std::mutex> Lock(SnapshotMutex);
+    Previous = Current;
+    Current.playerPos = Player.position();
+    Current.tick = Ticks;
+    Current.time = std::chrono::steady_clock::now();
+    ChangedBlocks.insert(ChangedBlocks.end(), Changed.begin(), Changed.end());
+    ChangedBoxes.insert(ChangedBoxes.end(), Boxes.begin(), Boxes.end());
+    if (RecordInputs)
+      TickInputs.push_back(In);
+  }
+
+  void timedTick() {
+    auto Start = std::chrono::steady_clock::now();
+    tick();
+    // If nobody collects them, tick times are dropped.
+    TickTimes.push(std::chrono::duration<float, std::milli>(
+      std::chrono::steady_clock::now() - Start).count());
+  }
+
+  void run() {
+    typedef std::chrono::steady_clock Clock;
+    const auto TickDuration = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<float>(TickLength));
+
+    PROFILE_THREAD("simulation");
+    auto NextTick = Clock::now();
+    while (Running) {
+      timedTick();
+      auto End = Clock::now();
+
+      NextTick += TickDuration;
+      // Don't try to catch up forever if we fell far behind.
+      if (End - NextTick > TickDuration * 5)
+        NextTick = End;
+      std::this_thread::sleep_until(NextTick);
+    }
+  }
+
+public:
+  Simulation(Space &space, MovingEntity &Player, std::vector<VoxelChunk *> Chunks,
+             float TickLength = 1 / 60.0f)
+    : space(space), Player(Player), Chunks(Chunks), TickLength(TickLength),
+      Running(false) {
+    Current.playerPos = Player.position();
+    Current.time = std::chrono::steady_clock::now();
+    Previous = Current;
+  }
+
+  ~Simulation() {
+    stop();
+  }
+
+  void start() {
+    if (Running)
+      return;
+    Running = true;
+    Thread = std::thread(&Simulation::run, this);
+  }
+
+  void stop() {
+    if (!Running)
+      return;
+    Running = false;
+    Thread.join();
+  }
+
+  // Runs a single tick on the calling thread, for driving the simulation
+  // without its own thread. Only allowed while it isn't started.
+  void step() {
+    assert(!Running);
+    timedTick();
+  }
+
+  // Has to be held by anyone reading voxels outside of the simulation
+  // thread, e.g. while meshing.
+  std::mutex &getWorldMutex() {
+    return WorldMutex;
+  }
+
+  // Updates the continuous part of the input and queues the actions that are
+  // set in the given input.
+  void setInput(const PlayerInput &NewInput) {
+    std::lock_guard<std::mutex> Lock(InputMutex);
+    bool jump = Input.jump, breakBlock = Input.breakBlock, placeBlock = Input.placeBlock;
+    Input = NewInput;
+    Input.jump |= jump;
+    Input.breakBlock |= breakBlock;
+    Input.placeBlock |= placeBlock;
+  }
+
+  // Returns the player position interpolated between the last two ticks.
+  v3f getInterpolatedPlayerPos() {
+    std::lock_guard<std::mutex> Lock(SnapshotMutex);
+    float alpha = std::chrono::duration<float>(
+      std::chrono::steady_clock::now() - Current.time).count() / TickLength;
+    alpha = std::max(0.0f, std::min(1.0f, alpha));
+    const v3f &a = Previous.playerPos;
+    const v3f &b = Current.playerPos;
+    return v3f(a.x + (b.x - a.x) * alpha,
+               a.y + (b.y - a.y) * alpha,
+               a.z + (b.z - a.z) * alpha);
+  }
+
+  // Returns all blocks that were changed since the last call.
+  std::vector<v3> takeChangedBlocks() {
+    std::lock_guard<std::mutex> Lock(SnapshotMutex);
+    std::vector<v3> Result;
+    Result.swap(ChangedBlocks);
+    return Result;
+  }
+
+  // Returns the boxes changed by edits since the last call. Unlike single
+  // blocks, these are remeshed as a whole.
+  std::vector<std::pair<v3, v3>> takeChangedBoxes() {
+    std::lock_guard<std::mutex> Lock(SnapshotMutex);
+    std::vector<std::pair<v3, v3>> Result;
+    Result.swap(ChangedBoxes);
+    return Result;
+  }
+
+  // Applies the edit to all chunks in the next tick. Edits aren't part of
+  // input recordings.
+  void queueEdit(VoxelEdit Edit) {
+    std::lock_guard<std::mutex> Lock(InputMutex);
+    PendingEdits.push_back(std::move(Edit));
+  }
+
+  // Makes every tick log the input it consumed, which takeTickInputs()
+  // returns. Has to be set before the simulation starts.
+  void setRecordInputs(bool Record) {
+    assert(!Running);
+    RecordInputs = Record;
+  }
+
+  // Returns the inputs of all ticks since the last call, oldest first.
+  std::vector<PlayerInput> takeTickInputs() {
+    std::lock_guard<std::mutex> Lock(SnapshotMutex);
+    std::vector<PlayerInput> Result;
+    Result.swap(TickInputs);
+    return Result;
+  }
+
+  // Number of ticks simulated so far.
+  uint64_t getTicks() {
+    std::lock_guard<std::mutex> Lock(SnapshotMutex);
+    return Current.tick;
+  }
+
+  // Takes the duration of the oldest tick that wasn't taken yet. Returns
+  // false if there is none. Only one thread may take tick times.
+  bool takeTickMillis(float &Millis) {
+    return TickTimes.pop(Millis);
+  }
+
+  float getTickLength() const {
+    return TickLength;
+  }
+};
+
+#endif // SIMULATION_H
@@ -0,0 +1 @@
+#include "SkyBox.h"
@@ -0,0 +1,176 @@
+#ifndef SKYBOX_H
+#define SKYBOX_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <functional>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include "GLState.h"
+
+// A background that doesn't move relative to the camera, baked into a cube
+// map. Drawing it is a single full screen pass with SkyVertexShader.vert
+// and SkyFragmentShader.frag, no matter how much geometry it was made of.
+//
+// Baked cube maps can be saved to and loaded from a file, so the scene only
+// has to be built and rendered once.
+class SkyBox {
+  GLuint CubeMap = 0;
+  // The full screen triangle is generated from gl_VertexID, but core
+  // profiles still need a vertex array to draw.
+  GLuint VertexArrayID = 0;
+  int FaceSize;
+  bool Initialized = false;
+
+  static constexpr const char *FileMagic = "TSSKY1";
+
+  void init() {
+    Initialized = true;
+    glGenTextures(1, &CubeMap);
+    GLState.bindTexture(0, GL_TEXTURE_CUBE_MAP, CubeMap);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    glGenVertexArrays(1, &VertexArrayID);
+  }
+
+  // Allocates all faces, filled with the given data if it isn't null.
+  void setFaces(const uint8_t *Data) {
+    if (!Initialized)
+      init();
+    const size_t FaceBytes = (size_t) FaceSize * FaceSize * 3;
+    GLState.bindTexture(0, GL_TEXTURE_CUBE_MAP, CubeMap);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int face = 0; face < 6; ++face)
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, FaceSize, FaceSize, 0,
+                   GL_RGB, GL_UNSIGNED_BYTE, Data ? Data + face * FaceBytes : nullptr);
+  }
+
+public:
+  SkyBox(int FaceSize = 1024) : FaceSize(FaceSize) {
+  }
+
+  ~SkyBox() {
+    if (!Initialized)
+      return;
+    GLState.deleteTextures(1, &CubeMap);
+    GLState.deleteVertexArrays(1, &VertexArrayID);
+  }
+
+  int getFaceSize() const {
+    return FaceSize;
+  }
+
+  // Renders the six faces from the origin. Draw is called once per face
+  // with the view projection matrix of that face and has to draw the whole
+  // scene, setting up its own programs. The viewport, framebuffer, and face
+  // culling are restored afterwards.
+  void bake(const std::function<void(const glm::mat4 &)> &Draw) {
+    setFaces(nullptr);
+
+    GLint OldViewport[4];
+    glGetIntegerv(GL_VIEWPORT, OldViewport);
+    GLint OldFramebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &OldFramebuffer);
+    const GLboolean Culling = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+
+    GLuint Framebuffer, DepthBuffer;
+    glGenFramebuffers(1, &Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+    glGenRenderbuffers(1, &DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, FaceSize, FaceSize);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, DepthBuffer);
+    glViewport(0, 0, FaceSize, FaceSize);
+
+    // Looking along each face's axis with the up vectors that match the
+    // orientation of cube map faces.
+    static const glm::vec3 Directions[6] = {
+      {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+    };
+    static const glm::vec3 Ups[6] = {
+      {0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}
+    };
+    const glm::mat4 Projection = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 30000.0f);
+    for (int face = 0; face < 6; ++face) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, CubeMap, 0);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      Draw(Projection * glm::lookAt(glm::vec3(0), Directions[face], Ups[face]));
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, OldFramebuffer);
+    glDeleteFramebuffers(1, &Framebuffer);
+    glDeleteRenderbuffers(1, &DepthBuffer);
+    glViewport(OldViewport[0], OldViewport[1], OldViewport[2], OldViewport[3]);
+    if (Culling)
+      glEnable(GL_CULL_FACE);
+  }
+
+  // Loads a cube map written by save(). Returns false if the file doesn't
+  // exist or doesn't match the face size.
+  bool load(const std::string &Path) {
+    std::ifstream In(Path, std::ios::binary);
+    if (!In)
+      return false;
+    char Magic[8] = {};
+    int32_t Size = 0;
+    In.read(Magic, std::strlen(FileMagic));
+    In.read(reinterpret_cast<char *>(&Size), sizeof(Size));
+    if (!In || std::strcmp(Magic, FileMagic) != 0 || Size != FaceSize)
+      return false;
+
+    std::vector<uint8_t> Data((size_t) FaceSize * FaceSize * 3 * 6);
+    In.read(reinterpret_cast<char *>(Data.data()), Data.size());
+    if (!In)
+      return false;
+    setFaces(Data.data());
+    return true;
+  }
+
+  // Writes the baked cube map to the given file.
+  bool save(const std::string &Path) {
+    if (!Initialized)
+      return false;
+    const size_t FaceBytes = (size_t) FaceSize * FaceSize * 3;
+    std::vector<uint8_t> Data(FaceBytes * 6);
+    GLState.bindTexture(0, GL_TEXTURE_CUBE_MAP, CubeMap);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int face = 0; face < 6; ++face)
+      glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, GL_UNSIGNED_BYTE,
+                    Data.data() + face * FaceBytes);
+
+    std::ofstream Out(Path, std::ios::binary);
+    const int32_t Size = FaceSize;
+    Out.write(FileMagic, std::strlen(FileMagic));
+    Out.write(reinterpret_cast<const char *>(&Size), sizeof(Size));
+    Out.write(reinterpret_cast<const char *>(Data.data()), Data.size());
+    return (bool) Out;
+  }
+
+  // Draws the sky behind everything already drawn. The sky program has to
+  // be in use, with the inverse of the projection times the rotation of the
+  // view in its "inverseViewProjection" uniform.
+  void draw() {
+    if (!Initialized)
+      return;
+    GLState.bindTexture(0, GL_TEXTURE_CUBE_MAP, CubeMap);
+    GLState.bindVertexArray(VertexArrayID);
+    // The triangle lies on the far plane and must not hide anything.
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+  }
+};
+
+#endif // SKYBOX_H
@@ -0,0 +1 @@
+#include "StarField.h"
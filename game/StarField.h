@@ -0,0 +1,62 @@
+#ifndef STARFIELD_H
+#define STARFIELD_H
+
+#include <GL/glew.h>
+#include <string>
+#include <glm/glm.hpp>
+#include "Texture.h"
+#include "VertexLayout.h"
+
+// Stars drawn as billboards that are generated in StarVertexShader.vert.
+// Every star is a single instance of a few bytes, the six vertices of its
+// quad only exist in the vertex shader, so the number of stars barely
+// matters for startup time or memory.
+class StarField {
+  // Position of the center and half the width of the billboard, then the
+  // tile of the texture (0 or 255 on each axis), brightness and padding.
+  typedef VertexLayout<Attribute<GLfloat, 4>, Attribute<GLubyte, 4, true>> Layout;
+
+  VertexBuffer<Layout> Stars;
+
+  TextureID Texture;
+
+public:
+  StarField(const std::string &TexturePath)
+    : Texture(TexMgr.loadTexture(TexturePath)) {
+  }
+
+  void reserve(size_t count) {
+    Stars.reserve(count);
+  }
+
+  // Adds a star using the given tile of a texture with 2x2 tiles.
+  void add(const glm::vec3 &position, float size, int tileU, int tileV, float light) {
+    Layout::Vertex &S = Stars.add();
+    S.get<0>().set(position.x, position.y, position.z, size);
+    S.get<1>().setNormalized(tileU ? 1.0f : 0.0f, tileV ? 1.0f : 0.0f, light, 0.0f);
+  }
+
+  size_t size() const {
+    return Stars.size();
+  }
+
+  void reset() {
+    Stars.reset();
+  }
+
+  // Uploads the stars, every one of them is an instance.
+  void finalize() {
+    Stars.finalize(1);
+  }
+
+  // Has to be called with the star program in use.
+  void draw() {
+    if (Stars.size() == 0)
+      return;
+
+    Texture.activate();
+    Stars.drawInstanced(GL_TRIANGLES, 6);
+  }
+};
+
+#endif // STARFIELD_H
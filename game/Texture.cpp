@@ -7,5 +7,5 @@ const std::string &TextureID::getPath() {
 TextureManager TexMgr;
 
 void TextureID::activate() {
-  TexMgr[ID].activate();
+  TexMgr.activate(ID);
 }
@@ -16,6 +16,7 @@
 #include <cstring>
 #include <sstream>
 #include <cassert>
+#include "GLState.h"
 
 inline void split(const std::string &s, char delim, std::vector<std::string> &elems) {
   std::stringstream ss(s);
@@ -49,10 +50,9 @@ public:
 
   void activate() {
     // Bind our texture in Texture Unit 0
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, Handle);
-    // Set our "myTextureSampler" sampler to user Texture Unit 0
-    glUniform1i(Handle, 0);
+    GLState.bindTexture(0, GL_TEXTURE_2D, Handle);
+    // "myTextureSampler" isn't set here. Samplers default to texture unit 0,
+    // and Handle is a texture name, not a uniform location.
   }
 
   void clear() {
@@ -68,6 +68,10 @@ public:
 
   void activate();
 
+  unsigned getID() const {
+    return ID;
+  }
+
   const std::string &getPath();
 };
 
@@ -78,8 +82,6 @@ class TextureManager {
   std::unordered_map<std::string, unsigned> TexturesNamedToIDs;
   std::unordered_map<unsigned, std::string> IDsToTextureNames;
 
-  unsigned LastActivatedID = std::numeric_limits<unsigned>::max();
-
 public:
   TextureManager() {
   }
@@ -91,6 +93,8 @@ public:
     } else {
       unsigned OldSize = Textures.size();
       Textures.push_back(Texture(Path));
+      // Loading binds the new texture without telling the state cache.
+      GLState.invalidate();
       TexturesNamedToIDs[Path] = OldSize;
       IDsToTextureNames[OldSize] = Path;
       return TextureID(OldSize);
@@ -105,11 +109,9 @@ public:
     return IDsToTextureNames[ID];
   }
 
+  // Redundant binds are filtered by the GL state cache.
   void activate(unsigned ID) {
-    if (ID != LastActivatedID) {
-      operator[](ID).activate();
-      LastActivatedID = ID;
-    }
+    operator[](ID).activate();
   }
 };
 
@@ -0,0 +1 @@
+#include "VertexLayout.h"
@@ -0,0 +1,224 @@
+#ifndef VERTEXLAYOUT_H
+#define VERTEXLAYOUT_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "GLState.h"
+
+// The GL enum of a component type.
+template<typename T> struct GLTypeOf;
+template<> struct GLTypeOf<GLfloat> { static const GLenum Value = GL_FLOAT; };
+template<> struct GLTypeOf<GLbyte> { static const GLenum Value = GL_BYTE; };
+template<> struct GLTypeOf<GLubyte> { static const GLenum Value = GL_UNSIGNED_BYTE; };
+template<> struct GLTypeOf<GLshort> { static const GLenum Value = GL_SHORT; };
+template<> struct GLTypeOf<GLushort> { static const GLenum Value = GL_UNSIGNED_SHORT; };
+
+// A vertex attribute with Count components of type T. Integer components
+// reach the shader as floats, either as they are or, if Normalized is set,
+// mapped to [0, 1] (or [-1, 1] for signed types).
+template<typename T, int Count, bool Normalized = false>
+struct Attribute {
+  static_assert(Count >= 1 && Count <= 4, "attributes have 1 to 4 components");
+
+  T Values[Count];
+
+  template<typename... Components>
+  void set(Components... C) {
+    static_assert(sizeof...(Components) == Count, "wrong number of components");
+    const T Converted[] = {static_cast<T>(C)...};
+    std::copy(Converted, Converted + Count, Values);
+  }
+
+  // Stores floats in [0, 1] (or [-1, 1]) into a normalized attribute.
+  template<typename... Components>
+  void setNormalized(Components... C) {
+    static_assert(Normalized, "only normalized attributes convert floats");
+    set(normalize(C)...);
+  }
+
+  static T normalize(float f) {
+    const float Min = std::numeric_limits<T>::is_signed ? -1.0f : 0.0f;
+    f = std::max(Min, std::min(1.0f, f));
+    return static_cast<T>(std::round(f * std::numeric_limits<T>::max()));
+  }
+
+  // Points the attribute at the given index at its place inside the vertex.
+  static void enable(GLuint Index, GLsizei Stride, size_t Offset, GLuint Divisor) {
+    glEnableVertexAttribArray(Index);
+    glVertexAttribPointer(Index, Count, GLTypeOf<T>::Value, Normalized ? GL_TRUE : GL_FALSE,
+                          Stride, (void *) Offset);
+    glVertexAttribDivisor(Index, Divisor);
+  }
+};
+
+// The attributes of a vertex stored back to back in the given order.
+template<typename... Attributes> struct PackedAttributes;
+
+// Access to the attribute at index I of PackedAttributes.
+template<unsigned I, typename Packed>
+struct PackedAttribute {
+  typedef PackedAttribute<I - 1, decltype(Packed::Tail)> Next;
+  typedef typename Next::Type Type;
+
+  static Type &get(Packed &P) {
+    return Next::get(P.Tail);
+  }
+};
+
+template<typename Packed>
+struct PackedAttribute<0, Packed> {
+  typedef decltype(Packed::Head) Type;
+
+  static Type &get(Packed &P) {
+    return P.Head;
+  }
+};
+
+template<typename Last>
+struct PackedAttributes<Last> {
+  Last Head;
+
+  template<unsigned I>
+  typename PackedAttribute<I, PackedAttributes>::Type &get() {
+    return PackedAttribute<I, PackedAttributes>::get(*this);
+  }
+
+  static void enable(GLuint Index, GLsizei Stride, size_t Offset, GLuint Divisor) {
+    Last::enable(Index, Stride, Offset, Divisor);
+  }
+};
+
+template<typename First, typename Second, typename... Rest>
+struct PackedAttributes<First, Second, Rest...> {
+  First Head;
+  PackedAttributes<Second, Rest...> Tail;
+
+  template<unsigned I>
+  typename PackedAttribute<I, PackedAttributes>::Type &get() {
+    return PackedAttribute<I, PackedAttributes>::get(*this);
+  }
+
+  static void enable(GLuint Index, GLsizei Stride, size_t Offset, GLuint Divisor) {
+    First::enable(Index, Stride, Offset + offsetof(PackedAttributes, Head), Divisor);
+    PackedAttributes<Second, Rest...>::enable(Index + 1, Stride,
+                                              Offset + offsetof(PackedAttributes, Tail),
+                                              Divisor);
+  }
+};
+
+// Describes interleaved vertices made of the given attributes, which are
+// bound to the attribute locations 0, 1, ... in order. The vertex type is a
+// plain struct, so vertices can be collected in a std::vector and uploaded
+// into a single buffer as they are.
+//
+// Attributes are only padded to the alignment of their component type, so
+// the ones with smaller types should come last.
+template<typename... Attributes>
+struct VertexLayout {
+  typedef PackedAttributes<Attributes...> Vertex;
+
+  static const GLsizei Stride = sizeof(Vertex);
+
+  // Sets up all attributes of the bound vertex array to read from the
+  // buffer bound to GL_ARRAY_BUFFER. A divisor of 1 makes every vertex an
+  // instance.
+  static void setup(GLuint Divisor = 0) {
+    Vertex::enable(0, Stride, 0, Divisor);
+  }
+};
+
+// A vertex array with a single buffer of interleaved vertices. Vertices are
+// collected on the CPU and uploaded once by finalize(), which is also the
+// only time the attributes are set up.
+template<typename Layout>
+class VertexBuffer {
+public:
+  typedef typename Layout::Vertex Vertex;
+
+private:
+  std::vector<Vertex> Vertices;
+  GLsizei Count = 0;
+
+  GLuint Buffer = 0;
+  GLuint VertexArrayID = 0;
+
+  bool Finalized = false;
+
+public:
+  VertexBuffer() {
+  }
+
+  VertexBuffer(const VertexBuffer &) = delete;
+  VertexBuffer &operator=(const VertexBuffer &) = delete;
+
+  ~VertexBuffer() {
+    reset();
+  }
+
+  void reserve(size_t count) {
+    Vertices.reserve(count);
+  }
+
+  // Appends a vertex that still has to be filled in.
+  Vertex &add() {
+    assert(!Finalized);
+    Vertices.emplace_back();
+    return Vertices.back();
+  }
+
+  // Number of vertices added so far.
+  GLsizei size() const {
+    return Finalized ? Count : (GLsizei) Vertices.size();
+  }
+
+  void reset() {
+    Vertices.clear();
+    Count = 0;
+    if (!Finalized)
+      return;
+    Finalized = false;
+    GLState.deleteBuffers(1, &Buffer);
+    GLState.deleteVertexArrays(1, &VertexArrayID);
+  }
+
+  // Uploads the vertices and frees the CPU copy.
+  void finalize(GLuint Divisor = 0) {
+    assert(!Finalized);
+    Finalized = true;
+    Count = (GLsizei) Vertices.size();
+
+    glGenVertexArrays(1, &VertexArrayID);
+    GLState.bindVertexArray(VertexArrayID);
+
+    glGenBuffers(1, &Buffer);
+    GLState.bindBuffer(GL_ARRAY_BUFFER, Buffer);
+    glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertex), Vertices.data(),
+                 GL_STATIC_DRAW);
+    Layout::setup(Divisor);
+
+    std::vector<Vertex>().swap(Vertices);
+  }
+
+  void draw(GLenum Mode) {
+    if (!Finalized || Count == 0)
+      return;
+    GLState.bindVertexArray(VertexArrayID);
+    glDrawArrays(Mode, 0, Count);
+  }
+
+  // Draws the given vertices once for every vertex in the buffer, which has
+  // to be finalized with a divisor of 1.
+  void drawInstanced(GLenum Mode, GLsizei VerticesPerInstance) {
+    if (!Finalized || Count == 0)
+      return;
+    GLState.bindVertexArray(VertexArrayID);
+    glDrawArraysInstanced(Mode, 0, VerticesPerInstance, Count);
+  }
+};
+
+#endif // VERTEXLAYOUT_H
@@ -38,8 +38,9 @@ public:
     GENERATOR,
     CRATE,
     GLASS,
-    AIRLOCK
+    AIRLOCK,
 
+    TYPE_COUNT
   };
   Voxel() {
     assert(isDark());
@@ -95,6 +96,12 @@ public:
     }
   }
 
+  // Whether the texture of this voxel has magenta texels that have to be
+  // discarded. In textures.bmp only the glass tile uses them.
+  bool hasCutout() const {
+    return Type == GLASS;
+  }
+
   float lightPercent() const {
     return ((float) light()) / std::numeric_limits<uint8_t>::max();
   }
@@ -107,6 +114,10 @@ public:
     return Type == T;
   }
 
+  Types getType() const {
+    return (Types) Type;
+  }
+
   bool isBuildable() const {
     return Type != AIR && Type != SPACE;
   }
@@ -117,6 +128,11 @@ public:
 
   void callback(bool added, const v3 &pos, VoxelChunk &Chunk);
 
+  // Whether callback() does anything for voxels of this type.
+  bool hasCallback() const {
+    return Type == LAMP;
+  }
+
 
 #define VOXEL_NAME_MACRO(ENUM) case ENUM : return #ENUM
 
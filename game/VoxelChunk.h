@@ -2,9 +2,11 @@
 #define VOXELCHUNK_H
 
 #include "Voxel.h"
+#include "VoxelEdit.h"
 #include <vector>
 #include <random>
 #include <unordered_set>
+#include <utility>
 #include <iostream>
 #include "stb_perlin.h"
 
@@ -146,6 +148,10 @@ class VoxelChunk {
 
     const int64_t maxLightDistance = 8;
 
+    LightChanges.emplace_back(
+      startPos - v3(maxLightDistance, maxLightDistance, maxLightDistance),
+      startPos + v3(maxLightDistance + 1, maxLightDistance + 1, maxLightDistance + 1));
+
     for (int64_t x = -maxLightDistance + startPos.x; x <= maxLightDistance + startPos.x; ++x) {
       for (int64_t y = -maxLightDistance + startPos.y; y <= maxLightDistance + startPos.y; ++y) {
         for (int64_t z = -maxLightDistance + startPos.z; z <= maxLightDistance + startPos.z; ++z) {
@@ -216,6 +222,10 @@ class VoxelChunk {
 
   std::unordered_set<v3> lights;
 
+  // Boxes [first, second) in which light changed since the last call to
+  // takeLightChanges().
+  std::vector<std::pair<v3, v3>> LightChanges;
+
   float spaceRecalcTimer = 10;
   float timeSinceLastSpaceRecalc = 9;
 
@@ -271,6 +281,34 @@ class VoxelChunk {
     }
   }
 
+  // Writes the part of a row of an edit that lies in the chunk. Only lamps
+  // have callbacks, so the voxels are usually just filled or copied.
+  void writeRow(const VoxelEdit::Row &R) {
+    const v3 Start = R.Start - offset;
+    if (Start.y < 0 || Start.y >= size.y || Start.z < 0 || Start.z >= size.z)
+      return;
+    const int64_t Begin = std::max<int64_t>(0, -Start.x);
+    const int64_t End = std::min<int64_t>(R.Length, size.x - Start.x);
+    if (Begin >= End)
+      return;
+
+    Voxel *Row = &Voxels[Start.x + Begin + Start.y * size.x + Start.z * size.x * size.y];
+    const int64_t Count = End - Begin;
+    const v3 First = R.Start + v3(Begin, 0, 0);
+    for (int64_t i = 0; i < Count; ++i)
+      if (Row[i].hasCallback())
+        Row[i].callback(false, First + v3(i, 0, 0), *this);
+    if (R.Source)
+      std::transform(R.Source + Begin, R.Source + End, Row,
+                     [](Voxel::Types T) { return Voxel(T); });
+    else
+      std::fill(Row, Row + Count, Voxel(R.Type));
+    if (Voxel(R.Type).hasCallback() || R.Source)
+      for (int64_t i = 0; i < Count; ++i)
+        if (Row[i].hasCallback())
+          Row[i].callback(true, First + v3(i, 0, 0), *this);
+  }
+
   void recalcSpace() {
     //return; // TODO
     for (int64_t x = offset.x; x < size.x + offset.x; ++x) {
@@ -377,16 +415,91 @@ public:
     }
   }
 
+  // Applies the part of an edit that lies in this chunk and returns the
+  // boxes it changed, clipped to the chunk. Like setBlock(), the lights
+  // near the changes are taken away before and spread again after, but
+  // only once for the whole edit.
+  std::vector<std::pair<v3, v3>> apply(const VoxelEdit &Edit) {
+    std::vector<std::pair<v3, v3>> Boxes;
+    for (const auto &B : Edit.getBoxes()) {
+      const v3 Min(std::max(B.first.x, offset.x), std::max(B.first.y, offset.y),
+                   std::max(B.first.z, offset.z));
+      const v3 Max(std::min(B.second.x, offset.x + size.x),
+                   std::min(B.second.y, offset.y + size.y),
+                   std::min(B.second.z, offset.z + size.z));
+      if (Min.x < Max.x && Min.y < Max.y && Min.z < Max.z)
+        Boxes.emplace_back(Min, Max);
+    }
+    if (Boxes.empty())
+      return Boxes;
+
+    // Light spreads at most this far from a lamp along each axis.
+    const int64_t Reach = 8;
+    auto isNear = [&](const v3 &Light) {
+      for (const auto &B : Boxes)
+        if (Light.x >= B.first.x - Reach && Light.x < B.second.x + Reach &&
+            Light.y >= B.first.y - Reach && Light.y < B.second.y + Reach &&
+            Light.z >= B.first.z - Reach && Light.z < B.second.z + Reach)
+          return true;
+      return false;
+    };
+
+    for (auto &light : lights)
+      if (isNear(light))
+        spreadLight(light, false);
+
+    Edit.forEachRow([this](const VoxelEdit::Row &R) { writeRow(R); });
+
+    for (auto &light : lights)
+      if (isNear(light))
+        spreadLight(light, true);
+    return Boxes;
+  }
+
+  // Copies the types of the voxels in the box [Min, Max), to be pasted
+  // with VoxelEdit::paste().
+  VoxelRegion copy(v3 Min, v3 Max) {
+    VoxelRegion Result;
+    Result.Size = Max - Min;
+    if (Result.Size.x <= 0 || Result.Size.y <= 0 || Result.Size.z <= 0)
+      return VoxelRegion();
+    Result.Types.reserve(Result.Size.x * Result.Size.y * Result.Size.z);
+    for (int64_t z = Min.z; z < Max.z; ++z)
+      for (int64_t y = Min.y; y < Max.y; ++y)
+        for (int64_t x = Min.x; x < Max.x; ++x)
+          Result.Types.push_back(get({x, y, z}).getType());
+    return Result;
+  }
+
   void relight() {
     for (auto &light : lights) {
       spreadLight(light, true);
     }
   }
 
+  // Returns the boxes in which light changed since the last call, so
+  // renderers can update their copy of it.
+  std::vector<std::pair<v3, v3>> takeLightChanges() {
+    std::vector<std::pair<v3, v3>> Result;
+    Result.swap(LightChanges);
+    return Result;
+  }
+
   const v3& getSize() const {
     return size;
   }
 
+  // FNV-1a hash of the type and light of every voxel, for telling whether
+  // two runs ended in the same state.
+  uint64_t hash() const {
+    uint64_t H = 14695981039346656037ULL;
+    for (const Voxel &V : Voxels) {
+      H = (H ^ V.getType()) * 1099511628211ULL;
+      H = (H ^ V.light()) * 1099511628211ULL;
+    }
+    return H;
+  }
+
 
   Voxel& get(v3 pos) {
     pos -= offset;
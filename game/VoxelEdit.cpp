@@ -0,0 +1 @@
+#include "VoxelEdit.h"
@@ -0,0 +1,134 @@
+#ifndef VOXELEDIT_H
+#define VOXELEDIT_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "Voxel.h"
+#include "v3.h"
+
+// Voxel types of a box copied out of a chunk, x varying fastest, then y,
+// then z.
+struct VoxelRegion {
+  v3 Size = v3(0, 0, 0);
+  std::vector<Voxel::Types> Types;
+};
+
+// A batch of block changes, applied to a chunk at once by
+// VoxelChunk::apply(). Unlike setBlock() for every block, the lights around
+// the changes are only taken away and spread again once for the whole
+// batch, and voxels are written row by row.
+//
+// Operations are applied in the order they were added. Boxes are half
+// open, [Min, Max).
+class VoxelEdit {
+public:
+  // A run of voxels along x, filled with Type or copied from Source.
+  struct Row {
+    v3 Start;
+    int64_t Length;
+    Voxel::Types Type;
+    const Voxel::Types *Source;
+  };
+
+private:
+  enum OpKind { FILL_BOX, FILL_SPHERE, PASTE, SET_BLOCK };
+
+  struct Op {
+    OpKind Kind;
+    v3 Min, Max;
+    Voxel::Types Type;
+    // Squared radius of spheres, index into Regions of pastes.
+    int64_t Param;
+  };
+
+  std::vector<Op> Ops;
+  std::vector<VoxelRegion> Regions;
+  // Bounds of the operations, [first, second).
+  std::vector<std::pair<v3, v3>> Boxes;
+
+  void add(OpKind Kind, v3 Min, v3 Max, Voxel::Types Type, int64_t Param = 0) {
+    Ops.push_back({Kind, Min, Max, Type, Param});
+    Boxes.emplace_back(Min, Max);
+  }
+
+public:
+  void fillBox(v3 Min, v3 Max, Voxel::Types Type) {
+    if (Min.x < Max.x && Min.y < Max.y && Min.z < Max.z)
+      add(FILL_BOX, Min, Max, Type);
+  }
+
+  // Fills all voxels whose distance to Center is at most Radius.
+  void fillSphere(v3 Center, float Radius, Voxel::Types Type) {
+    if (Radius < 0)
+      return;
+    const int64_t R = (int64_t) Radius;
+    add(FILL_SPHERE, Center - v3(R, R, R), Center + v3(R + 1, R + 1, R + 1), Type,
+        (int64_t) (Radius * Radius));
+  }
+
+  // Writes the copied region with its lowest corner at At.
+  void paste(VoxelRegion Region, v3 At) {
+    if (Region.Types.empty())
+      return;
+    Regions.push_back(std::move(Region));
+    add(PASTE, At, At + Regions.back().Size, Voxel::SPACE, Regions.size() - 1);
+  }
+
+  void setBlock(v3 Pos, Voxel::Types Type) {
+    add(SET_BLOCK, Pos, Pos + v3(1, 1, 1), Type);
+  }
+
+  void setBlocks(const std::vector<std::pair<v3, Voxel::Types>> &Blocks) {
+    for (const auto &B : Blocks)
+      setBlock(B.first, B.second);
+  }
+
+  bool empty() const {
+    return Ops.empty();
+  }
+
+  // Boxes containing everything the operations change, one per operation.
+  const std::vector<std::pair<v3, v3>> &getBoxes() const {
+    return Boxes;
+  }
+
+  // Calls F with every row the operations write, in order.
+  template <typename Fn> void forEachRow(Fn F) const {
+    for (const Op &O : Ops) {
+      switch (O.Kind) {
+        case FILL_BOX:
+        case SET_BLOCK:
+          for (int64_t z = O.Min.z; z < O.Max.z; ++z)
+            for (int64_t y = O.Min.y; y < O.Max.y; ++y)
+              F(Row{v3(O.Min.x, y, z), O.Max.x - O.Min.x, O.Type, nullptr});
+          break;
+        case FILL_SPHERE: {
+          const int64_t R = (O.Max.x - O.Min.x - 1) / 2;
+          const v3 Center = O.Min + v3(R, R, R);
+          for (int64_t dz = -R; dz <= R; ++dz)
+            for (int64_t dy = -R; dy <= R; ++dy) {
+              const int64_t Rest = O.Param - dy * dy - dz * dz;
+              if (Rest < 0)
+                continue;
+              const int64_t Half = (int64_t) std::sqrt((double) Rest);
+              F(Row{v3(Center.x - Half, Center.y + dy, Center.z + dz), 2 * Half + 1, O.Type,
+                    nullptr});
+            }
+          break;
+        }
+        case PASTE: {
+          const VoxelRegion &Region = Regions[O.Param];
+          for (int64_t z = 0; z < Region.Size.z; ++z)
+            for (int64_t y = 0; y < Region.Size.y; ++y)
+              F(Row{O.Min + v3(0, y, z), Region.Size.x, O.Type,
+                    &Region.Types[(y + z * Region.Size.y) * Region.Size.x]});
+          break;
+        }
+      }
+    }
+  }
+};
+
+#endif // VOXELEDIT_H
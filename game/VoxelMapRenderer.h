@@ -5,12 +5,19 @@
 #include "Map.h"
 #include "v3.h"
 #include "BlockSideArray.h"
+#include "LightAtlas.h"
+#include <memory>
 
+// The corners of the odd sides are listed clockwise when looking at the
+// side from the outside, so they are reversed when added.
 #define ADD_VOXEL_SIDE(Ax, Ay, Az, Bx, By, Bz, Cx, Cy, Cz, Dx, Dy, Dz, side) \
   if (!V.S[side].blocksView()){                                    \
     GLfloat u = V.getUVOffset(side).first;                         \
     GLfloat v = V.getUVOffset(side).second;                        \
-    Array.add({   (float) Ax, (float) Ay, (float) Az,              \
+    BlockSideArray::Pass pass = V.V.hasCutout()                    \
+      ? BlockSideArray::CUTOUT_PASS : BlockSideArray::OPAQUE_PASS; \
+    int slot = Array.add(pass, side, (side & 1) != 0,              \
+              {   (float) Ax, (float) Ay, (float) Az,              \
                   (float) Bx, (float) By, (float) Bz,              \
                   (float) Cx, (float) Cy, (float) Cz,              \
                   (float) Cx, (float) Cy, (float) Cz,              \
@@ -22,26 +29,274 @@
                   u + us,   v + vs,                                \
                   u, v + vs,                                       \
                   u, v                                             \
-                  }, V.S[side].lightPercent(),                     \
+                  }, lightTexel(x, y, z, side),                    \
                   getOcclusionLighting({x, y, z}, side));          \
+    if (slot < 0)                                                  \
+      return false;                                                \
+    QuadSlots[quadIndex(x, y, z, side)] =                          \
+      slot * BlockSideArray::PASS_COUNT + pass;                    \
   }
 
 class VoxelMapRenderer {
+public:
+  // Number of detail levels. Level n reduces every 2^n voxels along each
+  // axis to a single cell, so distant sections need far fewer sides.
+  static const unsigned LOD_COUNT = 4;
 
+private:
   VoxelChunk *Map;
+  GeometryArena *Arena;
   BlockSideArray Array;
 
+  // Meshes of the coarser levels, and for every level the sides on the
+  // section border that are hidden by the neighbouring section. Drawing the
+  // latter closes the gaps towards a neighbour drawn at a different level.
+  // All of them are only built when needed and dropped on every change.
+  std::array<std::unique_ptr<BlockSideArray>, LOD_COUNT> LodArrays;
+  std::array<std::unique_ptr<BlockSideArray>, LOD_COUNT> SeamArrays;
+  // Bit n is set if LodArrays[n] is built, bit LOD_COUNT + n for the seams.
+  uint8_t Built = 0;
+
+  LightAtlas *Lights;
+  // Slot in the light atlas, only allocated while the section has sides.
+  int LightSlot = -1;
+  // Added to a voxel position to get its texel in the light atlas.
+  v3 LightOrigin;
+
+  // For every side of every voxel the slot of its quad times PASS_COUNT
+  // plus its pass, or -1 if the side isn't visible. Lets single voxels be
+  // patched without rebuilding the section. Empty while the section is.
+  std::vector<int32_t> QuadSlots;
+
   v3 offset;
   v3 size = v3(getSize(), getSize(), getSize());
 
+  // For every face of the section, the mask of faces it can see through
+  // non-opaque voxels. Uses the same numbering as the voxel sides.
+  std::array<uint8_t, 6> Connected;
+
+  // Largest box of opaque voxels inside the section, used as occluder.
+  bool HasOccluder = false;
+  glm::vec3 OccluderMin;
+  glm::vec3 OccluderMax;
+
+  // Returns for every voxel of the section whether it can be seen through,
+  // indexed by x + y * S + z * S * S.
+  std::vector<uint8_t> readOpenVoxels() {
+    const int64_t S = (int64_t) getSize();
+    std::vector<uint8_t> Open(S * S * S);
+    for (int64_t x = 0; x < S; ++x)
+      for (int64_t y = 0; y < S; ++y)
+        for (int64_t z = 0; z < S; ++z)
+          Open[x + y * S + z * S * S] =
+            !Map->get(v3(x, y, z) + offset).blocksView();
+    return Open;
+  }
+
+  void computeOccluder(const std::vector<uint8_t> &Open) {
+    const int64_t S = (int64_t) getSize();
+    const int64_t P = S + 1;
+    // Summed volume table of opaque voxels.
+    std::vector<int> Sum(P * P * P, 0);
+    auto at = [P](int64_t x, int64_t y, int64_t z) {
+      return x + y * P + z * P * P;
+    };
+    for (int64_t z = 1; z <= S; ++z)
+      for (int64_t y = 1; y <= S; ++y)
+        for (int64_t x = 1; x <= S; ++x)
+          Sum[at(x, y, z)] = !Open[(x - 1) + (y - 1) * S + (z - 1) * S * S]
+            + Sum[at(x - 1, y, z)] + Sum[at(x, y - 1, z)] + Sum[at(x, y, z - 1)]
+            - Sum[at(x - 1, y - 1, z)] - Sum[at(x - 1, y, z - 1)] - Sum[at(x, y - 1, z - 1)]
+            + Sum[at(x - 1, y - 1, z - 1)];
+
+    // Whether the box [min, max) is completely opaque.
+    auto solid = [&](const v3 &min, const v3 &max) {
+      int volume = Sum[at(max.x, max.y, max.z)]
+        - Sum[at(min.x, max.y, max.z)] - Sum[at(max.x, min.y, max.z)] - Sum[at(max.x, max.y, min.z)]
+        + Sum[at(min.x, min.y, max.z)] + Sum[at(min.x, max.y, min.z)] + Sum[at(max.x, min.y, min.z)]
+        - Sum[at(min.x, min.y, min.z)];
+      return volume == (max.x - min.x) * (max.y - min.y) * (max.z - min.z);
+    };
+
+    // Smaller boxes don't hide enough to be worth rasterizing.
+    const int64_t minOccluderSize = 4;
+
+    HasOccluder = false;
+    v3 min, max;
+    for (int64_t size = S; size >= minOccluderSize && !HasOccluder; --size)
+      for (int64_t z = 0; z + size <= S && !HasOccluder; ++z)
+        for (int64_t y = 0; y + size <= S && !HasOccluder; ++y)
+          for (int64_t x = 0; x + size <= S && !HasOccluder; ++x)
+            if (solid(v3(x, y, z), v3(x + size, y + size, z + size))) {
+              min = v3(x, y, z);
+              max = v3(x + size, y + size, z + size);
+              HasOccluder = true;
+            }
+    if (!HasOccluder)
+      return;
+
+    // Grow the cube into a box as long as it stays opaque.
+    for (bool grown = true; grown;) {
+      grown = false;
+      if (min.x > 0 && solid(v3(min.x - 1, min.y, min.z), v3(min.x, max.y, max.z))) { --min.x; grown = true; }
+      if (max.x < S && solid(v3(max.x, min.y, min.z), v3(max.x + 1, max.y, max.z))) { ++max.x; grown = true; }
+      if (min.y > 0 && solid(v3(min.x, min.y - 1, min.z), v3(max.x, min.y, max.z))) { --min.y; grown = true; }
+      if (max.y < S && solid(v3(min.x, max.y, min.z), v3(max.x, max.y + 1, max.z))) { ++max.y; grown = true; }
+      if (min.z > 0 && solid(v3(min.x, min.y, min.z - 1), v3(max.x, max.y, min.z))) { --min.z; grown = true; }
+      if (max.z < S && solid(v3(min.x, min.y, max.z), v3(max.x, max.y, max.z + 1))) { ++max.z; grown = true; }
+    }
+
+    min += offset;
+    max += offset;
+    OccluderMin = glm::vec3(min.x, min.y, min.z);
+    OccluderMax = glm::vec3(max.x, max.y, max.z);
+  }
+
+  void computeConnectivity(std::vector<uint8_t> Open) {
+    const int64_t S = (int64_t) getSize();
+
+    Connected.fill(0);
+    std::vector<int64_t> ToHandle;
+    for (int64_t start = 0; start < S * S * S; ++start) {
+      if (!Open[start])
+        continue;
+      Open[start] = 0;
+      ToHandle.push_back(start);
+
+      uint8_t Faces = 0;
+      while (!ToHandle.empty()) {
+        int64_t i = ToHandle.back();
+        ToHandle.pop_back();
+        int64_t x = i % S, y = (i / S) % S, z = i / (S * S);
+
+        if (y == S - 1) Faces |= 1 << 0;
+        if (y == 0)     Faces |= 1 << 1;
+        if (z == 0)     Faces |= 1 << 2;
+        if (z == S - 1) Faces |= 1 << 3;
+        if (x == 0)     Faces |= 1 << 4;
+        if (x == S - 1) Faces |= 1 << 5;
+
+        for (unsigned face = 0; face < 6; ++face) {
+          v3 n = v3(x, y, z) + faceOffset(face);
+          if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= S || n.y >= S || n.z >= S)
+            continue;
+          int64_t ni = n.x + n.y * S + n.z * S * S;
+          if (!Open[ni])
+            continue;
+          Open[ni] = 0;
+          ToHandle.push_back(ni);
+        }
+      }
+
+      for (unsigned face = 0; face < 6; ++face)
+        if (Faces & (1 << face))
+          Connected[face] |= Faces;
+    }
+  }
+
+  glm::vec3 lightTexel(int64_t x, int64_t y, int64_t z, unsigned side) const {
+    v3 texel = v3(x, y, z) + faceOffset(side) + LightOrigin;
+    return glm::vec3(texel.x, texel.y, texel.z);
+  }
+
+  // Copies the light of the voxels in [min, max) into the atlas slot. The
+  // box is clipped to the section and its border.
+  void uploadLight(v3 min, v3 max) {
+    const v3 slotMin = offset - v3(1, 1, 1);
+    const v3 slotMax = offset + size + v3(1, 1, 1);
+    min = v3(std::max(min.x, slotMin.x), std::max(min.y, slotMin.y), std::max(min.z, slotMin.z));
+    max = v3(std::min(max.x, slotMax.x), std::min(max.y, slotMax.y), std::min(max.z, slotMax.z));
+    if (min.x >= max.x || min.y >= max.y || min.z >= max.z)
+      return;
+
+    for (int64_t z = min.z; z < max.z; ++z)
+      for (int64_t y = min.y; y < max.y; ++y)
+        for (int64_t x = min.x; x < max.x; ++x)
+          Lights->at(LightSlot, v3(x, y, z) - slotMin) = Map->get(v3(x, y, z)).light();
+    Lights->upload(LightSlot, min - slotMin, max - slotMin);
+  }
+
+  size_t quadIndex(int64_t x, int64_t y, int64_t z, unsigned side) const {
+    const int64_t S = (int64_t) getSize();
+    return ((x - offset.x) + (y - offset.y) * S + (z - offset.z) * S * S) * 6 + side;
+  }
+
+  // Adds the visible sides of the voxel. Returns false if they didn't fit
+  // into a finalized array.
+  bool addVoxel(int64_t x, int64_t y, int64_t z) {
+    AnnotatedVoxel V = Map->getAnnotated(v3(x, y, z));
+    if (V.V.transparent())
+      return true;
+    const float us = Voxel::TEX_SIZE;
+    const float vs = us;
+
+    ADD_VOXEL_SIDE(
+      x, y + 1, z,
+      x, y + 1, z + 1,
+      x + 1, y + 1, z + 1,
+      x + 1, y + 1, z,
+      0);
+    ADD_VOXEL_SIDE(
+      x, y, z,
+      x, y, z + 1,
+      x + 1, y, z + 1,
+      x + 1, y, z,
+      1);
+    ADD_VOXEL_SIDE(
+      x, y + 1, z,
+      x + 1, y + 1, z,
+      x + 1, y, z,
+      x, y, z,
+      2);
+    ADD_VOXEL_SIDE(
+      x, y + 1, z + 1,
+      x + 1, y + 1, z + 1,
+      x + 1, y, z + 1,
+      x, y, z + 1,
+      3);
+    ADD_VOXEL_SIDE(
+      x, y + 1, z + 1,
+      x, y + 1, z,
+      x, y, z,
+      x, y, z + 1,
+      4);
+    ADD_VOXEL_SIDE(
+      x + 1, y + 1, z + 1,
+      x + 1, y + 1, z,
+      x + 1, y, z,
+      x + 1, y, z + 1,
+      5);
+    return true;
+  }
+
+  void removeVoxel(int64_t x, int64_t y, int64_t z) {
+    for (unsigned side = 0; side < 6; ++side) {
+      int32_t &Quad = QuadSlots[quadIndex(x, y, z, side)];
+      if (Quad < 0)
+        continue;
+      Array.remove((BlockSideArray::Pass) (Quad % BlockSideArray::PASS_COUNT),
+                   side, Quad / BlockSideArray::PASS_COUNT);
+      Quad = -1;
+    }
+  }
+
   static constexpr float ONE_THIRD = 1.0f / 3.0f;
 
 #define LIGHT_SUM(ax, ay, az, bx, by, bz, cx, cy, cz) \
-   (Map->get({pos.x + ax, pos.y + ay, pos.z + az}).transparent() ? ONE_THIRD : 0.1f) \
- + (Map->get({pos.x + bx, pos.y + by, pos.z + bz}).transparent() ? ONE_THIRD : 0.1f) \
- + (Map->get({pos.x + cx, pos.y + cy, pos.z + cz}).transparent() ? ONE_THIRD : 0.1f);
+   (open(ax, ay, az) ? ONE_THIRD : 0.1f) \
+ + (open(bx, by, bz) ? ONE_THIRD : 0.1f) \
+ + (open(cx, cy, cz) ? ONE_THIRD : 0.1f);
 
   std::array<GLfloat, 6> getOcclusionLighting(const v3& pos, unsigned side) {
+    return occlusion(side, [this, &pos](int64_t x, int64_t y, int64_t z) {
+      return Map->get({pos.x + x, pos.y + y, pos.z + z}).transparent();
+    });
+  }
+
+  // Ambient occlusion of the corners of a side. open(x, y, z) returns
+  // whether the neighbour at that offset lets light through.
+  template<typename OpenFn>
+  static std::array<GLfloat, 6> occlusion(unsigned side, OpenFn open) {
     std::array<GLfloat, 6> Result = {1, 1, 1, 1, 1, 1};
     switch(side) {
       case 0: {
@@ -138,17 +393,219 @@ class VoxelMapRenderer {
     return Result;
   }
 
+  // Reduces the section and one cell around it to cells of 2^level voxels
+  // along each axis. A cell becomes the most common visible voxel inside it
+  // if at least half of its voxels are visible, otherwise it stays empty.
+  // Cells are indexed by (x + 1) + (y + 1) * G + (z + 1) * G * G with
+  // G = getSize() / 2^level + 2.
+  std::vector<Voxel> downsample(unsigned level) {
+    const int64_t n = int64_t(1) << level;
+    const int64_t C = (int64_t) getSize() / n;
+    const int64_t G = C + 2;
+    std::vector<Voxel> Cells(G * G * G);
+    std::array<int, Voxel::TYPE_COUNT> Counts;
+    for (int64_t cz = -1; cz <= C; ++cz)
+      for (int64_t cy = -1; cy <= C; ++cy)
+        for (int64_t cx = -1; cx <= C; ++cx) {
+          const v3 min = offset + v3(cx, cy, cz) * n;
+          Counts.fill(0);
+          int64_t visible = 0;
+          for (int64_t z = 0; z < n; ++z)
+            for (int64_t y = 0; y < n; ++y)
+              for (int64_t x = 0; x < n; ++x) {
+                const Voxel &V = Map->get(min + v3(x, y, z));
+                if (V.transparent())
+                  continue;
+                ++visible;
+                ++Counts[V.getType()];
+              }
+          if (visible * 2 < n * n * n)
+            continue;
+          auto Most = std::max_element(Counts.begin(), Counts.end());
+          Cells[(cx + 1) + (cy + 1) * G + (cz + 1) * G * G] =
+            Voxel((Voxel::Types) (Most - Counts.begin()));
+        }
+    return Cells;
+  }
+
+  // Adds a side of a cell with n voxels along each axis whose lowest corner
+  // is min. Uses the same corners and winding as ADD_VOXEL_SIDE, the texture
+  // is stretched over the whole cell.
+  static void addCellSide(BlockSideArray &A, const Voxel &V, bool airAbove,
+                          const v3 &min, int64_t n, unsigned side,
+                          const glm::vec3 &lightTexel, const std::array<GLfloat, 6> &o) {
+    static const int Corners[6][4][3] = {
+      {{0, 1, 0}, {0, 1, 1}, {1, 1, 1}, {1, 1, 0}},
+      {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0}},
+      {{0, 1, 0}, {1, 1, 0}, {1, 0, 0}, {0, 0, 0}},
+      {{0, 1, 1}, {1, 1, 1}, {1, 0, 1}, {0, 0, 1}},
+      {{0, 1, 1}, {0, 1, 0}, {0, 0, 0}, {0, 0, 1}},
+      {{1, 1, 1}, {1, 1, 0}, {1, 0, 0}, {1, 0, 1}},
+    };
+    std::vector<GLfloat> Vertexes;
+    for (int i : {0, 1, 2, 2, 3, 0}) {
+      const int *C = Corners[side][i];
+      Vertexes.push_back((float) (min.x + C[0] * n));
+      Vertexes.push_back((float) (min.y + C[1] * n));
+      Vertexes.push_back((float) (min.z + C[2] * n));
+    }
+    const float us = Voxel::TEX_SIZE;
+    const float vs = us;
+    const GLfloat u = V.getUVOffset(side, airAbove).first;
+    const GLfloat v = V.getUVOffset(side, airAbove).second;
+    A.add(V.hasCutout() ? BlockSideArray::CUTOUT_PASS : BlockSideArray::OPAQUE_PASS,
+          side, (side & 1) != 0, Vertexes,
+          {u, v, u + us, v, u + us, v + vs, u + us, v + vs, u, v + vs, u, v},
+          lightTexel, o);
+  }
+
+  // Builds the sides of the given level from its cells. Sides facing a cell
+  // that can be seen through go into the mesh of the level, which for level
+  // 0 is Array and never rebuilt here. Sides on the section border facing a
+  // cell that blocks view go into the seams of the level.
+  void buildLevel(unsigned level, bool faces, bool seams) {
+    assert(LightSlot >= 0);
+    assert(level > 0 || !faces);
+    const int64_t n = int64_t(1) << level;
+    const int64_t C = (int64_t) getSize() / n;
+    const int64_t G = C + 2;
+    const std::vector<Voxel> Cells = downsample(level);
+    auto cell = [&Cells, G](int64_t x, int64_t y, int64_t z) -> const Voxel & {
+      return Cells[(x + 1) + (y + 1) * G + (z + 1) * G * G];
+    };
+
+    BlockSideArray *Faces = nullptr;
+    BlockSideArray *Seams = nullptr;
+    if (faces) {
+      LodArrays[level].reset(new BlockSideArray(*Arena));
+      Faces = LodArrays[level].get();
+      Built |= 1 << level;
+    }
+    if (seams) {
+      SeamArrays[level].reset(new BlockSideArray(*Arena));
+      Seams = SeamArrays[level].get();
+      Built |= 1 << (LOD_COUNT + level);
+    }
+
+    for (int64_t z = 0; z < C; ++z)
+      for (int64_t y = 0; y < C; ++y)
+        for (int64_t x = 0; x < C; ++x) {
+          const Voxel &V = cell(x, y, z);
+          if (V.transparent())
+            continue;
+          const v3 min = offset + v3(x, y, z) * n;
+          for (unsigned side = 0; side < 6; ++side) {
+            const v3 &d = faceOffset(side);
+            const v3 c(x + d.x, y + d.y, z + d.z);
+            BlockSideArray *Target = Faces;
+            if (cell(c.x, c.y, c.z).blocksView()) {
+              const bool border = c.x < 0 || c.y < 0 || c.z < 0 ||
+                                  c.x >= C || c.y >= C || c.z >= C;
+              Target = border ? Seams : nullptr;
+            }
+            if (!Target)
+              continue;
+
+            // The side gets the light of the voxel in front of its center.
+            v3 front = min + v3(n / 2, n / 2, n / 2);
+            if (d.x) front.x = d.x > 0 ? min.x + n : min.x - 1;
+            if (d.y) front.y = d.y > 0 ? min.y + n : min.y - 1;
+            if (d.z) front.z = d.z > 0 ? min.z + n : min.z - 1;
+            front += LightOrigin;
+
+            addCellSide(*Target, V, cell(x, y + 1, z).isFree(), min, n, side,
+                        glm::vec3(front.x, front.y, front.z),
+                        occlusion(side, [&](int64_t ox, int64_t oy, int64_t oz) {
+                          return cell(x + ox, y + oy, z + oz).transparent();
+                        }));
+          }
+        }
+    // Levels and seams are rebuilt instead of patched, so they don't need
+    // any slack.
+    if (Faces)
+      Faces->finalize(false);
+    if (Seams)
+      Seams->finalize(false);
+  }
+
+  // Drops the meshes of all coarser levels and all seams.
+  void discardLevels() {
+    for (auto &A : LodArrays)
+      A.reset();
+    for (auto &A : SeamArrays)
+      A.reset();
+    Built = 0;
+  }
+
+  // Mask of the faces of sides inside the box [min, max] that can be seen
+  // from the given position. A side facing +y can only be seen from above
+  // its plane, which is never below the bottom of the box.
+  static uint8_t facesVisibleFrom(const glm::vec3 &cameraPos, const glm::vec3 &min,
+                                  const glm::vec3 &max) {
+    uint8_t Faces = 0;
+    if (cameraPos.y > min.y) Faces |= 1 << 0;
+    if (cameraPos.y < max.y) Faces |= 1 << 1;
+    if (cameraPos.z < max.z) Faces |= 1 << 2;
+    if (cameraPos.z > min.z) Faces |= 1 << 3;
+    if (cameraPos.x < max.x) Faces |= 1 << 4;
+    if (cameraPos.x > min.x) Faces |= 1 << 5;
+    return Faces;
+  }
+
 public:
-  VoxelMapRenderer(VoxelChunk &Map, v3 offset) : Array("textures.bmp:nearest") {
+  VoxelMapRenderer(VoxelChunk &Map, v3 offset, GeometryArena &Arena, LightAtlas &Lights)
+    : Arena(&Arena), Array(Arena), Lights(&Lights) {
     setMap(&Map, offset);
   }
-  VoxelMapRenderer() : Array("textures.bmp:nearest") {
+
+  ~VoxelMapRenderer() {
+    if (LightSlot >= 0)
+      Lights->free(LightSlot);
   }
 
   static size_t getSize() {
     return 16;
   }
 
+  // Direction of the given face/voxel side: top, bottom, -z, +z, -x, +x.
+  static const v3 &faceOffset(unsigned face) {
+    static const std::array<v3, 6> Offsets = {
+      v3(0, 1, 0),
+      v3(0, -1, 0),
+      v3(0, 0, -1),
+      v3(0, 0, 1),
+      v3(-1, 0, 0),
+      v3(1, 0, 0),
+    };
+    return Offsets[face];
+  }
+
+  static unsigned oppositeFace(unsigned face) {
+    return face ^ 1;
+  }
+
+  // Whether anything entering the section through face `from` can leave
+  // it through face `to`.
+  bool isConnected(unsigned from, unsigned to) const {
+    return (Connected[from] & (1 << to)) != 0;
+  }
+
+  const v3 &getOffset() const {
+    return offset;
+  }
+
+  bool hasOccluder() const {
+    return HasOccluder;
+  }
+
+  const glm::vec3 &occluderMin() const {
+    return OccluderMin;
+  }
+
+  const glm::vec3 &occluderMax() const {
+    return OccluderMax;
+  }
+
   void setMap(VoxelChunk *M, v3 offset) {
     this->offset = offset;
     this->size = size;
@@ -158,59 +615,139 @@ public:
 
   void recreate() {
     Array.reset();
-    for (int64_t x = offset.x; x < size.x + offset.x; ++x) {
-      for (int64_t y = offset.y; y < size.y + offset.y; ++y) {
-        for (int64_t z = offset.z; z < size.z + offset.z; ++z) {
-          AnnotatedVoxel V = Map->getAnnotated(v3(x, y, z));
-          if (V.V.transparent())
-            continue;
-          const float us = Voxel::TEX_SIZE;
-          const float vs = us;
-
-          ADD_VOXEL_SIDE(
-            x, y + 1, z,
-            x, y + 1, z + 1,
-            x + 1, y + 1, z + 1,
-            x + 1, y + 1, z,
-            0);
-          ADD_VOXEL_SIDE(
-            x, y, z,
-            x, y, z + 1,
-            x + 1, y, z + 1,
-            x + 1, y, z,
-            1);
-          ADD_VOXEL_SIDE(
-            x, y + 1, z,
-            x + 1, y + 1, z,
-            x + 1, y, z,
-            x, y, z,
-            2);
-          ADD_VOXEL_SIDE(
-            x, y + 1, z + 1,
-            x + 1, y + 1, z + 1,
-            x + 1, y, z + 1,
-            x, y, z + 1,
-            3);
-          ADD_VOXEL_SIDE(
-            x, y + 1, z + 1,
-            x, y + 1, z,
-            x, y, z,
-            x, y, z + 1,
-            4);
-          ADD_VOXEL_SIDE(
-            x + 1, y + 1, z + 1,
-            x + 1, y + 1, z,
-            x + 1, y, z,
-            x + 1, y, z + 1,
-            5);
-        }
+    discardLevels();
+    if (LightSlot < 0)
+      LightSlot = Lights->allocate();
+    LightOrigin = Lights->slotOrigin(LightSlot) - offset + v3(1, 1, 1);
+
+    QuadSlots.assign(size.x * size.y * size.z * 6, -1);
+    for (int64_t x = offset.x; x < size.x + offset.x; ++x)
+      for (int64_t y = offset.y; y < size.y + offset.y; ++y)
+        for (int64_t z = offset.z; z < size.z + offset.z; ++z)
+          addVoxel(x, y, z);
+    Array.finalize();
+
+    if (Array.empty()) {
+      Lights->free(LightSlot);
+      LightSlot = -1;
+      std::vector<int32_t>().swap(QuadSlots);
+    } else {
+      uploadLight(offset - v3(1, 1, 1), offset + size + v3(1, 1, 1));
+    }
+
+    std::vector<uint8_t> Open = readOpenVoxels();
+    computeOccluder(Open);
+    computeConnectivity(Open);
+  }
+
+  // Rebuilds the sides of the given voxels of this section in place, which
+  // is much cheaper than recreate() after a single block changed. Returns
+  // false if the section should be recreated instead, because it was empty
+  // or has too many holes. Running out of room for new sides would leave
+  // the removed ones missing, so the section is recreated right away then.
+  bool patch(const std::vector<v3> &Voxels) {
+    if (Array.empty())
+      return false;
+    discardLevels();
+    for (const v3 &P : Voxels)
+      removeVoxel(P.x, P.y, P.z);
+    for (const v3 &P : Voxels)
+      if (!addVoxel(P.x, P.y, P.z)) {
+        recreate();
+        return true;
       }
+    if (Array.fragmented())
+      return false;
+
+    std::vector<uint8_t> Open = readOpenVoxels();
+    computeOccluder(Open);
+    computeConnectivity(Open);
+    return true;
+  }
+
+  bool empty() const {
+    return Array.empty();
+  }
+
+  const glm::vec3 &boundsMin() const {
+    return Array.boundsMin();
+  }
+
+  const glm::vec3 &boundsMax() const {
+    return Array.boundsMax();
+  }
+
+  // Has to be called when the light of voxels in [min, max) changed without
+  // any blocks changing. Cheaper than recreate() as only light is uploaded.
+  void updateLight(const v3 &min, const v3 &max) {
+    if (LightSlot >= 0)
+      uploadLight(min, max);
+  }
+
+  // Parts that still have to be built to draw the section at the given
+  // level, with or without its seams, as a mask for build(). Level 0 itself
+  // always exists.
+  uint8_t missing(unsigned level, bool seams) const {
+    uint8_t Parts = 0;
+    if (level > 0 && !(Built & (1 << level)))
+      Parts |= 1 << level;
+    if (seams && !(Built & (1 << (LOD_COUNT + level))))
+      Parts |= 1 << (LOD_COUNT + level);
+    return Parts;
+  }
+
+  // Builds the given parts as returned by missing(), unless they were built
+  // in the meantime. Reads voxels, so the world mutex has to be held.
+  void build(uint8_t Parts) {
+    Parts &= ~Built;
+    for (unsigned level = 0; level < LOD_COUNT; ++level) {
+      const bool faces = (Parts & (1 << level)) != 0;
+      const bool seams = (Parts & (1 << (LOD_COUNT + level))) != 0;
+      if (faces || seams)
+        buildLevel(level, faces, seams);
     }
-    Array.finalize();
   }
 
-  void draw() {
-    Array.draw();
+  // Number of vertices drawn at the given level. Levels that aren't built
+  // yet are estimated, each level has roughly a quarter of the sides of the
+  // one before.
+  GLsizei vertexCount(unsigned level) const {
+    if (level == 0)
+      return Array.vertexCount();
+    if (Built & (1 << level))
+      return LodArrays[level]->vertexCount();
+    return Array.vertexCount() >> (2 * level);
+  }
+
+  // The given level has to be prepared.
+  const ArenaRange &getRange(BlockSideArray::Pass P, unsigned face,
+                             unsigned level = 0) const {
+    if (level == 0)
+      return Array.getRange(P, face);
+    assert(Built & (1 << level));
+    return LodArrays[level]->getRange(P, face);
+  }
+
+  // The seams of the given level have to be prepared.
+  const ArenaRange &getSeamRange(BlockSideArray::Pass P, unsigned face,
+                                 unsigned level) const {
+    assert(Built & (1 << (LOD_COUNT + level)));
+    return SeamArrays[level]->getRange(P, face);
+  }
+
+  // Mask of the faces of the given level that can be seen from the given
+  // position.
+  uint8_t visibleFaces(const glm::vec3 &cameraPos, unsigned level = 0) const {
+    const BlockSideArray &A = level == 0 ? Array : *LodArrays[level];
+    if (A.empty())
+      return 0;
+    return facesVisibleFrom(cameraPos, A.boundsMin(), A.boundsMax());
+  }
+
+  // Same for the seams, which all lie on the border of the section.
+  uint8_t visibleSeams(const glm::vec3 &cameraPos) const {
+    const glm::vec3 min(offset.x, offset.y, offset.z);
+    return facesVisibleFrom(cameraPos, min, min + glm::vec3(getSize()));
   }
 
 };
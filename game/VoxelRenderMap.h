@@ -5,20 +5,74 @@
 #include <cstdint>
 #include <cstddef>
 #include "Voxel.h"
+#include "RenderView.h"
+#include "RenderStats.h"
+#include "OcclusionBuffer.h"
+#include "GeometryArena.h"
+#include "LightAtlas.h"
+#include "Texture.h"
+#include "RemeshScheduler.h"
+#include "RenderQueue.h"
+#include "Profiler.h"
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
 
 class VoxelRenderMap {
 
   std::vector<VoxelMapRenderer *> Renders;
   VoxelChunk *Chunk;
+  GeometryArena *Arena;
+  LightAtlas *Lights;
+  RemeshScheduler *Scheduler;
+  TextureID Texture;
+
+  // A section that passed culling in the current frame.
+  struct VisibleSection {
+    // Squared distance to the camera.
+    float distance;
+    VoxelMapRenderer *R;
+    size_t index;
+    unsigned level;
+    // Faces towards neighbours drawn at a different level.
+    uint8_t seams;
+
+    VisibleSection(float distance, VoxelMapRenderer *R, size_t index)
+      : distance(distance), R(R), index(index), level(0), seams(0) {
+    }
+  };
+  std::vector<VisibleSection> Visible;
+  std::vector<bool> Seen;
+  // Faces every section was already left through while collecting the
+  // visible sections, one bit per face.
+  std::vector<uint8_t> Expanded;
+
+  // Sections are drawn at a coarser level while its cells cover at most
+  // this many pixels on screen.
+  float LodPixels = 2;
+  // Upper limit for the triangles drawn per frame. If the levels picked by
+  // size exceed it, the threshold is raised until they fit.
+  unsigned TriangleBudget = 1000000;
+  // The level of every section in the current frame.
+  std::vector<uint8_t> Levels;
+  // Level every section was last drawn at, and is drawn at this frame.
+  std::vector<uint8_t> DrawnLevels;
+  std::vector<uint8_t> Drawn;
+  // Size of one voxel on screen in pixels for every section.
+  std::vector<float> VoxelPixels;
 
 public:
-  VoxelRenderMap(VoxelChunk& Chunk) : Chunk(&Chunk) {
+  VoxelRenderMap(VoxelChunk& Chunk, GeometryArena &Arena, LightAtlas &Lights,
+                 RemeshScheduler &Scheduler)
+    : Chunk(&Chunk), Arena(&Arena), Lights(&Lights), Scheduler(&Scheduler),
+      // Headless maps are never drawn and there is no GL to load into.
+      Texture(Arena.headless() ? TextureID(0) : TexMgr.loadTexture("textures.bmp:nearest")) {
     const size_t renderSize = VoxelMapRenderer::getSize();
     for (int64_t x = Chunk.getOffset().x; x < Chunk.getOffset().x + Chunk.getSize().x; x += renderSize)
       for (int64_t y = Chunk.getOffset().y; y < Chunk.getOffset().y + Chunk.getSize().y; y += renderSize)
         for (int64_t z = Chunk.getOffset().z; z < Chunk.getOffset().z + Chunk.getSize().z; z += renderSize)
-          Renders.push_back(new VoxelMapRenderer(Chunk, v3(x, y, z)));
+          Renders.push_back(new VoxelMapRenderer(Chunk, v3(x, y, z), Arena, Lights));
   }
 
   VoxelMapRenderer *get(v3 pos) {
@@ -31,6 +85,7 @@ public:
     return nullptr;
   }
 
+  // Queues all sections around the given position for remeshing.
   void recreateSurrounding(v3 pos) {
     static const std::array<v3, 7> Offsets = {
       v3(0, 0, 0),
@@ -48,13 +103,372 @@ public:
           if (auto R = get(v3(pos.x + x * VoxelMapRenderer::getSize(),
                            pos.y + y * VoxelMapRenderer::getSize(),
                            pos.z + z * VoxelMapRenderer::getSize()))) {
-            R->recreate();
+            Scheduler->schedule(R);
           }
   }
 
-  void draw() {
-    for (auto &R : Renders)
-      R->draw();
+  // Updates the sections around a changed block. Besides the block itself
+  // only the sides of its neighbours can change, including the diagonal ones
+  // because of the ambient occlusion. Their quads are rewritten in place and
+  // sections where that isn't possible are queued for remeshing.
+  void patchBlock(const v3 &pos) {
+    PROFILE_SCOPE("patch block");
+    auto Start = std::chrono::steady_clock::now();
+    const v3 &min = Chunk->getOffset();
+    const v3 max = min + Chunk->getSize();
+
+    std::vector<std::pair<VoxelMapRenderer *, std::vector<v3>>> Patches;
+    for (int x = -1; x <= 1; ++x)
+      for (int y = -1; y <= 1; ++y)
+        for (int z = -1; z <= 1; ++z) {
+          v3 p(pos.x + x, pos.y + y, pos.z + z);
+          if (p.x < min.x || p.y < min.y || p.z < min.z ||
+              p.x >= max.x || p.y >= max.y || p.z >= max.z)
+            continue;
+          VoxelMapRenderer *R = get(p);
+          auto I = std::find_if(Patches.begin(), Patches.end(),
+                                [R](const std::pair<VoxelMapRenderer *, std::vector<v3>> &P) {
+                                  return P.first == R;
+                                });
+          if (I == Patches.end())
+            I = Patches.insert(Patches.end(), std::make_pair(R, std::vector<v3>()));
+          I->second.push_back(p);
+        }
+
+    for (auto &P : Patches) {
+      if (P.first->patch(P.second))
+        ++Stats.Patches;
+      else
+        Scheduler->schedule(P.first);
+    }
+    Stats.PatchMillis += std::chrono::duration<float, std::milli>(
+      std::chrono::steady_clock::now() - Start).count();
+  }
+
+  // Queues all sections with voxels in the box [min, max) for remeshing,
+  // and the ones next to it, whose border voxels and ambient occlusion may
+  // have changed too. For large edits this is much cheaper than patching
+  // every block.
+  void recreateBox(const v3 &min, const v3 &max) {
+    const v3 &o = Chunk->getOffset();
+    const v3 end = o + Chunk->getSize();
+    if (max.x < o.x || max.y < o.y || max.z < o.z ||
+        min.x > end.x || min.y > end.y || min.z > end.z)
+      return;
+    const int64_t rs = Chunk->getSize().x / VoxelMapRenderer::getSize();
+    const int64_t sectionSize = VoxelMapRenderer::getSize();
+    auto toSection = [&](int64_t coord, int64_t chunkOffset) {
+      return std::max<int64_t>(0, std::min<int64_t>(rs - 1, (coord - chunkOffset) / sectionSize));
+    };
+    for (int64_t x = toSection(min.x - 1, o.x); x <= toSection(max.x, o.x); ++x)
+      for (int64_t y = toSection(min.y - 1, o.y); y <= toSection(max.y, o.y); ++y)
+        for (int64_t z = toSection(min.z - 1, o.z); z <= toSection(max.z, o.z); ++z)
+          Scheduler->schedule(Renders[x * rs * rs + y * rs + z]);
+  }
+
+  // Uploads the light the chunk changed since the last call into the light
+  // atlas. Unlike block changes this doesn't need any remeshing.
+  void updateLight() {
+    auto Changes = Chunk->takeLightChanges();
+    if (Changes.empty())
+      return;
+    PROFILE_SCOPE("light update");
+
+    auto Start = std::chrono::steady_clock::now();
+    const int64_t rs = Chunk->getSize().x / VoxelMapRenderer::getSize();
+    const int64_t sectionSize = VoxelMapRenderer::getSize();
+    auto toSection = [&](int64_t coord, int64_t chunkOffset) {
+      return std::max<int64_t>(0, std::min<int64_t>(rs - 1, (coord - chunkOffset) / sectionSize));
+    };
+    const v3 &o = Chunk->getOffset();
+    for (auto &Box : Changes) {
+      // Sections also hold a one voxel border of their neighbours.
+      v3 min = Box.first - v3(1, 1, 1);
+      v3 max = Box.second;
+      for (int64_t x = toSection(min.x, o.x); x <= toSection(max.x, o.x); ++x)
+        for (int64_t y = toSection(min.y, o.y); y <= toSection(max.y, o.y); ++y)
+          for (int64_t z = toSection(min.z, o.z); z <= toSection(max.z, o.z); ++z) {
+            Renders[x * rs * rs + y * rs + z]->updateLight(Box.first, Box.second);
+            ++Stats.LightUpdates;
+          }
+    }
+    Stats.LightMillis += std::chrono::duration<float, std::milli>(
+      std::chrono::steady_clock::now() - Start).count();
+  }
+
+  // Collects the sections that are potentially visible. Starting at the
+  // section containing the camera (or the chunk border facing it), this
+  // walks through the sections, only leaving a section through faces that
+  // are connected to the one it was entered through and only moving away
+  // from the camera. Everything not reached is hidden behind opaque voxels.
+  //
+  // A section can be entered again through another face that is connected
+  // to exits the earlier entries weren't, and is then left through those.
+  void collectVisible(const RenderView &View) {
+    const int64_t rs = Chunk->getSize().x / VoxelMapRenderer::getSize();
+    const float sectionSize = VoxelMapRenderer::getSize();
+    const glm::vec3 chunkMin(Chunk->getOffset().x, Chunk->getOffset().y,
+                             Chunk->getOffset().z);
+    const glm::vec3 rel = (View.cameraPos - chunkMin) / sectionSize;
+
+    auto indexOf = [rs](const v3 &s) {
+      return s.x * rs * rs + s.y * rs + s.z;
+    };
+
+    // Section and the face through which it was entered, 6 for the section
+    // containing the camera.
+    std::vector<std::pair<v3, unsigned>> ToHandle;
+    Seen.assign(Renders.size(), false);
+    Expanded.assign(Renders.size(), 0);
+
+    // Faces a section can be left through when entered through the given
+    // one.
+    auto exitsFrom = [](const VoxelMapRenderer *R, unsigned entry) {
+      if (entry == 6)
+        return (uint8_t) 0x3F;
+      uint8_t Exits = 0;
+      for (unsigned face = 0; face < 6; ++face)
+        if (R->isConnected(entry, face))
+          Exits |= 1 << face;
+      return Exits;
+    };
+
+    v3 camSection((int64_t) std::floor(rel.x), (int64_t) std::floor(rel.y),
+                  (int64_t) std::floor(rel.z));
+    if (camSection.x >= 0 && camSection.y >= 0 && camSection.z >= 0 &&
+        camSection.x < rs && camSection.y < rs && camSection.z < rs) {
+      ToHandle.emplace_back(camSection, 6);
+    } else {
+      // Seed with all border sections on the sides facing the camera.
+      for (unsigned face = 0; face < 6; ++face) {
+        const v3 &dir = VoxelMapRenderer::faceOffset(face);
+        int axis = dir.x != 0 ? 0 : (dir.y != 0 ? 1 : 2);
+        int64_t camCoord = axis == 0 ? camSection.x : (axis == 1 ? camSection.y : camSection.z);
+        int64_t layer;
+        if (dir.x + dir.y + dir.z < 0) {
+          if (camCoord >= 0)
+            continue;
+          layer = 0;
+        } else {
+          if (camCoord < rs)
+            continue;
+          layer = rs - 1;
+        }
+        for (int64_t a = 0; a < rs; ++a)
+          for (int64_t b = 0; b < rs; ++b) {
+            v3 s = axis == 0 ? v3(layer, a, b) : (axis == 1 ? v3(a, layer, b) : v3(a, b, layer));
+            ToHandle.emplace_back(s, face);
+          }
+      }
+    }
+
+    for (size_t next = 0; next < ToHandle.size(); ++next) {
+      v3 s = ToHandle[next].first;
+      unsigned entry = ToHandle[next].second;
+
+      int64_t index = indexOf(s);
+      VoxelMapRenderer *R = Renders[index];
+      const uint8_t NewExits = exitsFrom(R, entry) & ~Expanded[index];
+      if (Seen[index] && !NewExits)
+        continue;
+      Expanded[index] |= NewExits;
+
+      if (!Seen[index]) {
+        Seen[index] = true;
+        glm::vec3 sectionMin = chunkMin + glm::vec3(s.x, s.y, s.z) * sectionSize;
+        glm::vec3 sectionMax = sectionMin + glm::vec3(sectionSize);
+        if (entry != 6 && !View.frustum.intersects(sectionMin, sectionMax)) {
+          // Never leave it, through whichever face it is entered.
+          Expanded[index] = 0x3F;
+          continue;
+        }
+
+        ++Stats.VisitedSections;
+        if (!R->empty() && View.frustum.intersects(R->boundsMin(), R->boundsMax())) {
+          if (View.occlusion && !View.occlusion->isVisible(R->boundsMin(), R->boundsMax()))
+            ++Stats.OccludedSections;
+          else
+            Visible.emplace_back(View.distanceSquared(R->boundsMin(), R->boundsMax()), R,
+                                 index);
+        }
+      }
+
+      for (unsigned face = 0; face < 6; ++face) {
+        if (!(NewExits & (1 << face)))
+          continue;
+        const v3 &dir = VoxelMapRenderer::faceOffset(face);
+        v3 n = s + dir;
+        if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= rs || n.y >= rs || n.z >= rs)
+          continue;
+        const int64_t nIndex = indexOf(n);
+        const unsigned nEntry = VoxelMapRenderer::oppositeFace(face);
+        if (Seen[nIndex] && !(exitsFrom(Renders[nIndex], nEntry) & ~Expanded[nIndex]))
+          continue;
+        // Only move away from the camera.
+        glm::vec3 nMin = chunkMin + glm::vec3(n.x, n.y, n.z) * sectionSize;
+        glm::vec3 nMax = nMin + glm::vec3(sectionSize);
+        if (dir.x > 0 && nMin.x < View.cameraPos.x) continue;
+        if (dir.x < 0 && nMax.x > View.cameraPos.x) continue;
+        if (dir.y > 0 && nMin.y < View.cameraPos.y) continue;
+        if (dir.y < 0 && nMax.y > View.cameraPos.y) continue;
+        if (dir.z > 0 && nMin.z < View.cameraPos.z) continue;
+        if (dir.z < 0 && nMax.z > View.cameraPos.z) continue;
+        ToHandle.emplace_back(n, nEntry);
+      }
+    }
+  }
+
+  // Offers the opaque boxes of all sections in the frustum as occluders.
+  void addOccluders(const RenderView &View, OcclusionBuffer &Occlusion) {
+    for (auto &R : Renders) {
+      if (!R->hasOccluder())
+        continue;
+      if (!View.frustum.intersects(R->occluderMin(), R->occluderMax()))
+        continue;
+      Occlusion.addOccluder(R->occluderMin(), R->occluderMax(),
+                            View.distanceSquared(R->occluderMin(), R->occluderMax()));
+    }
+  }
+
+  static unsigned levelFor(float voxelPixels, float threshold) {
+    unsigned level = 0;
+    while (level + 1 < VoxelMapRenderer::LOD_COUNT &&
+           voxelPixels * (1 << (level + 1)) <= threshold)
+      ++level;
+    return level;
+  }
+
+  // Picks the level of every section by how large its voxels are on screen,
+  // measured at the point of the section closest to the camera. The level
+  // only depends on the position of a section, so neighbours agree on which
+  // seams are needed even if one of them wasn't visible.
+  //
+  // Levels and seams that aren't built yet are queued in the scheduler,
+  // which builds them under the world lock within its budget. Until then a
+  // section keeps being drawn at the level it was drawn at before, or at
+  // full detail, and without the missing seams.
+  void selectLevels(const RenderView &View) {
+    const float sectionSize = VoxelMapRenderer::getSize();
+    VoxelPixels.resize(Renders.size());
+    for (size_t i = 0; i < Renders.size(); ++i) {
+      const v3 &o = Renders[i]->getOffset();
+      glm::vec3 min(o.x, o.y, o.z);
+      glm::vec3 max = min + glm::vec3(sectionSize);
+      VoxelPixels[i] = View.projectedSize(1, std::sqrt(View.distanceSquared(min, max)));
+    }
+
+    float threshold = LodPixels;
+    for (int attempt = 0; attempt < 12; ++attempt) {
+      size_t triangles = 0;
+      for (auto &V : Visible)
+        triangles += V.R->vertexCount(levelFor(VoxelPixels[V.index], threshold)) / 3;
+      if (triangles <= TriangleBudget)
+        break;
+      threshold *= 1.5f;
+    }
+
+    Levels.resize(Renders.size());
+    for (size_t i = 0; i < Renders.size(); ++i)
+      Levels[i] = levelFor(VoxelPixels[i], threshold);
+
+    DrawnLevels.resize(Renders.size(), 0);
+    Drawn = Levels;
+    for (auto &V : Visible) {
+      if (!V.R->missing(Levels[V.index], false))
+        continue;
+      const uint8_t Before = DrawnLevels[V.index];
+      Drawn[V.index] = V.R->missing(Before, false) ? 0 : Before;
+    }
+
+    const int64_t rs = Chunk->getSize().x / VoxelMapRenderer::getSize();
+    // Faces towards neighbours at another level in the given levels.
+    auto seamsIn = [rs](const std::vector<uint8_t> &L, size_t index) {
+      v3 s(index / (rs * rs), (index / rs) % rs, index % rs);
+      uint8_t Seams = 0;
+      for (unsigned face = 0; face < 6; ++face) {
+        v3 n = s + VoxelMapRenderer::faceOffset(face);
+        if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= rs || n.y >= rs || n.z >= rs)
+          continue;
+        if (L[n.x * rs * rs + n.y * rs + n.z] != L[index])
+          Seams |= 1 << face;
+      }
+      return Seams;
+    };
+    for (auto &V : Visible) {
+      V.level = Drawn[V.index];
+      V.seams = seamsIn(Drawn, V.index);
+      const uint8_t Parts = V.R->missing(Levels[V.index], seamsIn(Levels, V.index) != 0) |
+                            V.R->missing(V.level, V.seams != 0);
+      if (Parts)
+        Scheduler->scheduleLevels(V.R, Parts);
+      if (V.R->missing(V.level, V.seams != 0))
+        V.seams = 0;
+      DrawnLevels[V.index] = V.level;
+      if (V.level > 0)
+        ++Stats.LodSections;
+    }
+  }
+
+  void setTriangleBudget(unsigned Triangles) {
+    TriangleBudget = Triangles;
+  }
+
+  // Determines the potentially visible sections for this frame, sorts them
+  // front to back, so early depth testing can reject as many fragments as
+  // possible, and picks the level each one is drawn at.
+  void cull(const RenderView &View) {
+    PROFILE_SCOPE("cull");
+    Visible.clear();
+    for (auto &R : Renders) {
+      ++Stats.Sections;
+      if (!R->empty())
+        ++Stats.NonEmptySections;
+    }
+
+    collectVisible(View);
+
+    std::sort(Visible.begin(), Visible.end(),
+              [](const VisibleSection &A, const VisibleSection &B) {
+                return A.distance < B.distance;
+              });
+
+    Stats.VisibleSections += Visible.size();
+    selectLevels(View);
+  }
+
+  // Submits the sides of the given pass of all sections that survived the
+  // last cull() call at their level, plus the seams towards neighbours at
+  // a different level. Sides facing away from the camera are skipped per
+  // section, and neighbouring face ranges are merged by the queue.
+  void submit(const RenderView &View, BlockSideArray::Pass P, GLuint Program,
+              RenderQueue &Queue) {
+    if (Visible.empty())
+      return;
+    // Maps sharing an arena also share the light atlas, so the block
+    // texture is enough to tell whether draws can be merged.
+    TextureID Tex = Texture;
+    LightAtlas *L = Lights;
+    Queue.submitArena(P == BlockSideArray::OPAQUE_PASS ? RenderQueue::OPAQUE_PASS
+                                                       : RenderQueue::CUTOUT_PASS,
+                      Program, Texture.getID(), std::sqrt(Visible.front().distance),
+                      *Arena, [Tex, L]() mutable {
+                        Tex.activate();
+                        L->activate();
+                      });
+    for (auto &V : Visible) {
+      const uint8_t Faces = V.R->visibleFaces(View.cameraPos, V.level);
+      const uint8_t Seams = V.seams & V.R->visibleSeams(View.cameraPos);
+      auto addRange = [&Queue](const ArenaRange &Range) {
+        Stats.Triangles += Range.count / 3;
+        Queue.addRange(Range);
+      };
+      for (unsigned face = 0; face < BlockSideArray::FACE_COUNT; ++face)
+        if (Faces & (1 << face))
+          addRange(V.R->getRange(P, face, V.level));
+      for (unsigned face = 0; face < BlockSideArray::FACE_COUNT; ++face)
+        if (Seams & (1 << face))
+          addRange(V.R->getSeamRange(P, face, V.level));
+    }
   }
 };
 
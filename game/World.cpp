@@ -0,0 +1 @@
+#include "World.h"
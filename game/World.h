@@ -0,0 +1,48 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <cstdint>
+#include <cstring>
+#include "Map.h"
+#include "MovingEntity.h"
+#include "Simulation.h"
+
+// The spaceship, the meteor next to it and the player, together with the
+// simulation running them. Nothing here needs a window or GL, so the world
+// can also be simulated headless.
+class World {
+public:
+  VoxelChunk Ship;
+  VoxelChunk Meteor;
+  Space space;
+  MovingEntity Player;
+  Simulation Sim;
+
+  World()
+    : Ship({0, 0, 0}), Meteor({160, 0, 0}), Player(&space),
+      Sim(space, Player, {&Ship, &Meteor}) {
+    Ship.generateSpaceShip();
+    Meteor.generateMeteor();
+    space.add(Ship);
+    space.add(Meteor);
+  }
+
+  World(const World &) = delete;
+  World &operator=(const World &) = delete;
+
+  // Hash of the voxels, the player position and the number of ticks. Runs
+  // fed with the same inputs end with the same hash. Has to be called while
+  // the simulation isn't running.
+  uint64_t hash() {
+    uint64_t H = Ship.hash() * 31 + Meteor.hash();
+    const v3f P = Player.position();
+    for (float f : {P.x, P.y, P.z}) {
+      uint32_t Bits;
+      std::memcpy(&Bits, &f, sizeof(Bits));
+      H = H * 31 + Bits;
+    }
+    return H * 31 + Sim.getTicks();
+  }
+};
+
+#endif // WORLD_H
@@ -0,0 +1,169 @@
+// Renders fixed camera paths through the ship and meteor scenes into an
+// offscreen framebuffer and reports frame time statistics for every path.
+//
+// Only a hidden window is created for the GL context. On machines without
+// a display, SDL_VIDEODRIVER=offscreen gets a context through EGL, e.g.
+// from Mesa's software rasterizer. Like the game, this has to run in the
+// data directory.
+//
+// Meshing isn't timed. Before a path is timed, every section and level its
+// views need is built in an untimed pass over the path, and the remesh
+// budget is lifted, so every timed frame draws the same fully built
+// geometry no matter how fast the machine is.
+//
+// Usage: termination_shock_bench [--frames N] [--size WIDTHxHEIGHT]
+//          [--save DIR] [--save-every N] [--csv PREFIX] [--live-sky]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "RenderWindow.h"
+#include "OffscreenTarget.h"
+#include "SceneRenderer.h"
+#include "World.h"
+#include "FPSCounter.h"
+#include "RenderStats.h"
+
+namespace {
+
+// A camera path, evaluated for t from 0 to 1.
+struct CameraPath {
+  const char *Name;
+  glm::vec3 (*Position)(float t);
+  glm::vec3 (*Target)(float t);
+};
+
+const float Pi = 3.14159265f;
+
+// The ship spans 0 to 128 on every axis, the meteor starts at x = 160.
+const glm::vec3 ShipCenter(64, 64, 64);
+const glm::vec3 MeteorCenter(224, 64, 64);
+
+const CameraPath Paths[] = {
+  // Turns around once inside the ship.
+  {"interior",
+   [](float) { return glm::vec3(55, 14, 55); },
+   [](float t) { return glm::vec3(55 + std::cos(t * 2 * Pi), 14, 55 + std::sin(t * 2 * Pi)); }},
+  // Circles the ship from outside.
+  {"orbit",
+   [](float t) {
+     return ShipCenter + glm::vec3(std::cos(t * 2 * Pi) * 200, 60, std::sin(t * 2 * Pi) * 200);
+   },
+   [](float) { return ShipCenter; }},
+  // Approaches the meteor from far away, which covers the coarser levels.
+  {"approach",
+   [](float t) { return glm::mix(glm::vec3(-700, 150, 700), glm::vec3(140, 64, 64), t); },
+   [](float) { return MeteorCenter; }},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  unsigned Frames = 300;
+  int Width = 1280, Height = 720;
+  std::string SaveDir;
+  unsigned SaveEvery = 60;
+  std::string CsvPrefix;
+  bool LiveSky = false;
+  for (int i = 1; i < argc; ++i) {
+    const bool HasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--frames") == 0 && HasValue)
+      Frames = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--size") == 0 && HasValue)
+      std::sscanf(argv[++i], "%dx%d", &Width, &Height);
+    else if (std::strcmp(argv[i], "--save") == 0 && HasValue)
+      SaveDir = argv[++i];
+    else if (std::strcmp(argv[i], "--save-every") == 0 && HasValue)
+      SaveEvery = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--csv") == 0 && HasValue)
+      CsvPrefix = argv[++i];
+    else if (std::strcmp(argv[i], "--live-sky") == 0)
+      LiveSky = true;
+    else {
+      std::cerr << "Unknown argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  RenderWindow Window(Width, Height, true);
+  OffscreenTarget Target(Width, Height);
+  if (!Target.complete()) {
+    std::cerr << "Couldn't create the offscreen framebuffer" << std::endl;
+    return 1;
+  }
+
+  // The simulation isn't started, so the world stays as generated.
+  World TheWorld;
+  SceneRenderer Scene(TheWorld, LiveSky);
+
+  const glm::mat4 Projection = glm::perspective(45.0f, (float) Width / Height, 0.1f, 30000.0f);
+  Scene.getRemesher().setBudget(std::numeric_limits<float>::max());
+
+  bool Failed = false;
+  for (const CameraPath &Path : Paths) {
+    auto saveFrame = [&](uint64_t Frame, const uint8_t *Pixels) {
+      if (SaveDir.empty() || Frame % SaveEvery != 0)
+        return;
+      const std::string File = SaveDir + "/" + Path.Name + "-" + std::to_string(Frame) + ".ppm";
+      if (!OffscreenTarget::savePPM(File, Width, Height, Pixels)) {
+        std::cerr << "Couldn't write " << File << std::endl;
+        Failed = true;
+      }
+    };
+
+    auto renderFrame = [&](unsigned Frame) {
+      Stats.reset();
+      const float t = Frames > 1 ? Frame / (Frames - 1.0f) : 0;
+      const glm::vec3 Pos = Path.Position(t);
+      Target.bind();
+      Scene.render(Projection, glm::lookAt(Pos, Path.Target(t), glm::vec3(0, 1, 0)), Pos);
+    };
+
+    // Untimed pass that builds everything the path needs. Levels requested
+    // while culling a frame are built in the next one, so the first view is
+    // rendered again at the end to build the requests of the last one.
+    for (unsigned Frame = 0; Frame < Frames; ++Frame)
+      renderFrame(Frame);
+    renderFrame(0);
+    glFinish();
+
+    // Only the summary of the whole path is printed.
+    FPSCounter Counter;
+    Counter.setWindowMillis(std::numeric_limits<float>::max());
+
+    uint64_t DrawCalls = 0, Triangles = 0, Meshed = 0;
+    for (unsigned Frame = 0; Frame < Frames; ++Frame) {
+      renderFrame(Frame);
+      Target.readback(Frame, saveFrame);
+      Target.collect(false, saveFrame);
+      Counter.addFrame();
+      DrawCalls += Stats.DrawCalls;
+      Triangles += Stats.Triangles;
+      Meshed += Stats.Remeshes + Stats.LodBuilds;
+    }
+    Target.collect(true, saveFrame);
+
+    std::cout << Path.Name << ": ";
+    Counter.printSummary(Counter.summarizeAll(), std::cout);
+    std::cout << "  " << (DrawCalls / Frames) << " draw calls, " << (Triangles / Frames)
+              << " triangles per frame, " << Meshed << " sections meshed while timing"
+              << std::endl;
+    if (!CsvPrefix.empty()) {
+      const std::string File = CsvPrefix + "-" + Path.Name + ".csv";
+      if (!Counter.writeCSV(File)) {
+        std::cerr << "Couldn't write " << File << std::endl;
+        Failed = true;
+      }
+    }
+  }
+
+  return Failed ? 1 : 0;
+}
@@ -21,86 +21,129 @@ using namespace glm;
 #include <random>
 #include <map>
 #include <cstring>
+#include <cctype>
 #include <sstream>
+#include <limits>
 #include "Map.h"
 #include "Camera.h"
 #include "Controls.h"
 #include "Texture.h"
+#include "GLState.h"
 #include "VoxelRenderMap.h"
 #include "DeepSpaceRenderer.h"
+#include "SkyBox.h"
+#include "RenderQueue.h"
+#include "Profiler.h"
 #include "MovingEntity.h"
+#include "Simulation.h"
+#include "World.h"
+#include "Headless.h"
+#include "InputRecording.h"
+#include "SceneRenderer.h"
+#include "DynamicLights.h"
 
 # define M_PI           3.14159265358979323846  /* pi */
 
-int main(int argc, char** argv) {
-
-  Camera camera;
-  Controls controls;
-  RenderWindow window(1920, 1080);
-
-  // Dark blue background
-  glClearColor(0.00f, 0.00f, 0.00f, 1.0f);
-
-  // Enable depth test
-  glEnable(GL_DEPTH_TEST);
-  // Accept fragment if it closer to the camera than the former one
-  glDepthFunc(GL_LESS);
-
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-  // Cull triangles which normal is not towards the camera
-  // glEnable(GL_CULL_FACE);
-
-  // Create and compile our GLSL program from the shaders
-  GLuint BlockProgramID = LoadShaders("BlockVertexShader.vert",
-                                 "BlockFragmentShader.frag");
-
-  // Get a handle for our "MVP" uniform
-  GLuint MatrixID = glGetUniformLocation(BlockProgramID, "MVP");
+// Prints the hash of the world at the end of a session. Stores it in the
+// recording made during the session and checks it against the one being
+// replayed, if any. Returns false if something failed.
+static bool finishSession(World &TheWorld, InputRecording &Recording,
+                          const std::string &RecordPath, const InputRecording &Replay,
+                          const std::string &ReplayPath) {
+  const uint64_t Hash = TheWorld.hash();
+  std::cout << "World hash: " << std::hex << Hash << std::dec << " after "
+            << TheWorld.Sim.getTicks() << " ticks" << std::endl;
+  bool Result = true;
+  if (!RecordPath.empty()) {
+    Recording.setResult(Hash, TheWorld.Sim.getTicks());
+    if (Recording.save(RecordPath)) {
+      std::cout << "Wrote " << RecordPath << std::endl;
+    } else {
+      std::cerr << "Couldn't write " << RecordPath << std::endl;
+      Result = false;
+    }
+  }
+  if (!ReplayPath.empty() && Replay.hasResult()) {
+    if (Hash == Replay.getWorldHash() && TheWorld.Sim.getTicks() == Replay.getTicks()) {
+      std::cout << "Replay matches the recording" << std::endl;
+    } else {
+      std::cerr << "Replay diverged, the recording ended with hash " << std::hex
+                << Replay.getWorldHash() << std::dec << " after " << Replay.getTicks()
+                << " ticks" << std::endl;
+      Result = false;
+    }
+  }
+  return Result;
+}
 
-  // Get a handle for our "myTextureSampler" uniform
-  GLuint TextureID = glGetUniformLocation(BlockProgramID, "myTextureSampler");
+int main(int argc, char** argv) {
 
+  // Draw the deep space background as geometry every frame instead of
+  // baking it into a cube map.
+  bool LiveSky = false;
+  // Where the frame times are written on exit, if anywhere.
+  std::string FrameTimesPath;
+  // Simulate without opening a window, this many ticks unless replaying.
+  bool Headless = false;
+  // A minute of game time unless given.
+  uint64_t HeadlessTicks = 3600;
+  // Where the input of the session is recorded to, if anywhere.
+  std::string RecordPath;
+  // Replay this recording instead of taking input.
+  std::string ReplayPath;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--live-sky") == 0)
+      LiveSky = true;
+    else if (std::strcmp(argv[i], "--frame-times") == 0 && i + 1 < argc)
+      FrameTimesPath = argv[++i];
+    else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+      RecordPath = argv[++i];
+    else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+      ReplayPath = argv[++i];
+    else if (std::strcmp(argv[i], "--headless") == 0) {
+      Headless = true;
+      if (i + 1 < argc && std::isdigit((unsigned char) argv[i + 1][0]))
+        HeadlessTicks = std::strtoull(argv[++i], nullptr, 10);
+    }
+  }
 
-  // Create and compile our GLSL program from the shaders
-  GLuint SpaceProgramID = LoadShaders("DeepSpaceVertexShader.vert",
-                                      "DeepSpaceFragmentShader.frag");
+  InputRecording Recording;
+  InputRecording Replay;
+  if (!ReplayPath.empty() && !Replay.load(ReplayPath)) {
+    std::cerr << "Couldn't read " << ReplayPath << std::endl;
+    return 1;
+  }
 
-  // Get a handle for our "MVP" uniform
-  GLuint SpaceMatrixID = glGetUniformLocation(SpaceProgramID, "MVP");
+  if (Headless) {
+    HeadlessRunner Runner;
+    if (!RecordPath.empty())
+      Runner.setRecording(&Recording);
+    if (!ReplayPath.empty())
+      Runner.replay(Replay);
+    else
+      Runner.run(HeadlessTicks);
+    std::cout << "Session: ";
+    Runner.getCounter().printSummary(Runner.getCounter().summarizeAll(), std::cout);
+    bool Success = finishSession(Runner.getWorld(), Recording, RecordPath, Replay, ReplayPath);
+    if (!FrameTimesPath.empty() && !Runner.getCounter().writeCSV(FrameTimesPath)) {
+      std::cerr << "Couldn't write " << FrameTimesPath << std::endl;
+      Success = false;
+    }
+    return Success ? 0 : 1;
+  }
 
-  // Get a handle for our "myTextureSampler" uniform
-  GLuint SpaceTextureID = glGetUniformLocation(SpaceProgramID, "myTextureSampler");
+  Camera camera;
+  Controls controls;
+  RenderWindow window(1920, 1080);
 
   FPSCounter Counter;
 
   bool run = true;
 
-  //for (int x = 0; x < 100; x += 32) {
-  //  for (int z = 0; z < 100; z += 32) {
-  //    Chunks.push_back(VoxelChunk({x, 0, z}));
-  ///  }
-  //}
-
-  VoxelChunk Chunk({0, 0, 0});
-  Chunk.generateSpaceShip();
-
-  VoxelChunk Chunk2({160, 0, 0});
-  Chunk2.generateMeteor();
-
-  VoxelRenderMap Renderer(Chunk);
-  VoxelRenderMap Renderer2(Chunk2);
+  World TheWorld;
+  Simulation &Sim = TheWorld.Sim;
 
-  DeepSpaceRenderer DeepSpace;
-
-  MovingLight CameraLight(&Chunk);
-
-  Space space;
-  space.add(Chunk);
-  space.add(Chunk2);
-
-  MovingEntity Player(&space);
+  SceneRenderer Scene(TheWorld, LiveSky);
 
   std::vector<Voxel::Types> BlockTypes = {
     Voxel::CRATE,
@@ -111,148 +154,159 @@ int main(int argc, char** argv) {
   };
   Voxel::Types SelectedType = BlockTypes[0];
 
-  Uint64 LAST = 0;
-
-  do {
+  v3f PlayerPos = TheWorld.Player.position();
+  camera.setPos(PlayerPos.x, PlayerPos.y, PlayerPos.z);
 
-    Uint64 NOW = SDL_GetPerformanceCounter();
-    float deltaTime = (((float) NOW - LAST) / SDL_GetPerformanceFrequency());
-    if (LAST == 0)
-      deltaTime = 0;
-    LAST = NOW;
-
-    // Clear the screen
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // Replays step the simulation for every recorded tick of a frame before
+  // drawing it from the recorded camera, as fast as possible. Only escape
+  // is handled, which ends the replay early.
+  if (!ReplayPath.empty()) {
+    for (const RecordedFrame &Frame : Replay.getFrames()) {
+      if (!run)
+        break;
+      Stats.reset();
+      for (const PlayerInput &In : Frame.Ticks) {
+        Sim.setInput(In);
+        Sim.step();
+      }
+      Scene.render(camera.getProjectionMatrix(), Frame.ViewMatrix, Frame.CameraPos);
+      if (!RecordPath.empty())
+        Recording.addFrame(Frame);
+
+      float TickMillis;
+      while (Sim.takeTickMillis(TickMillis))
+        Counter.addTick(TickMillis);
+      Counter.addFrame();
+      window.swap();
+
+      SDL_Event event;
+      while (SDL_PollEvent(&event))
+        if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)
+          run = false;
+    }
 
+    std::cout << "Replay: ";
+    Counter.printSummary(Counter.summarizeAll(), std::cout);
+    if (!FrameTimesPath.empty() && !Counter.writeCSV(FrameTimesPath))
+      std::cerr << "Couldn't write " << FrameTimesPath << std::endl;
+    // An aborted replay can't match the recording.
+    if (!run)
+      return 0;
+    return finishSession(TheWorld, Recording, RecordPath, Replay, ReplayPath) ? 0 : 1;
+  }
 
-    // Compute the MVP matrix from keyboard and mouse input
-    glm::mat4 ProjectionMatrix = camera.getProjectionMatrix();
-    glm::mat4 ViewMatrix = camera.getViewMatrix();
-    glm::mat4 ModelMatrix = glm::mat4(1.0);
-    glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
+  Sim.setRecordInputs(!RecordPath.empty());
+  Sim.start();
 
-    // Use our shader
-    glUseProgram(BlockProgramID);
+  PROFILE_THREAD("main");
+  unsigned FrameTimeDumps = 0;
+  auto FrameStart = std::chrono::steady_clock::now();
+#ifdef PROFILER
+  unsigned Captures = 0;
+#endif
 
-    // Send our transformation to the currently bound shader,
-    // in the "MVP" uniform
-    glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+  do {
+    PROFILE_SCOPE("frame");
 
-    Renderer.draw();
-    Renderer2.draw();
+    Stats.reset();
 
-    // Use our shader
-    glUseProgram(SpaceProgramID);
+    PlayerPos = Sim.getInterpolatedPlayerPos();
+    camera.setPos(PlayerPos.x, PlayerPos.y, PlayerPos.z);
 
-    // Send our transformation to the currently bound shader,
-    // in the "MVP" uniform
-    glUniformMatrix4fv(SpaceMatrixID, 1, GL_FALSE, &MVP[0][0]);
+    // The camera follows keyboard and mouse input.
+    Scene.render(camera.getProjectionMatrix(), camera.getViewMatrix(), camera.getPosition());
 
-    DeepSpace.draw();
+    if (!RecordPath.empty()) {
+      auto Now = std::chrono::steady_clock::now();
+      RecordedFrame Frame;
+      Frame.DeltaMillis = std::chrono::duration<float, std::milli>(Now - FrameStart).count();
+      Frame.CameraPos = camera.getPosition();
+      Frame.ViewMatrix = camera.getViewMatrix();
+      Frame.Ticks = Sim.takeTickInputs();
+      Recording.addFrame(std::move(Frame));
+      FrameStart = Now;
+    }
 
+    float TickMillis;
+    while (Sim.takeTickMillis(TickMillis))
+      Counter.addTick(TickMillis);
     Counter.addFrame();
 
-    window.swap();
+    {
+      PROFILE_SCOPE("swap");
+      window.swap();
+    }
+    PROFILE_FRAME_END();
 
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
       if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)
         run = false;
+      // F10 writes the frame times recorded so far.
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F10) {
+        const std::string Path = "frametimes-" + std::to_string(FrameTimeDumps++) + ".csv";
+        if (Counter.writeCSV(Path))
+          std::cout << "Wrote " << Path << std::endl;
+        else
+          std::cerr << "Couldn't write " << Path << std::endl;
+      }
+#ifdef PROFILER
+      // F9 starts and stops a profile capture.
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9) {
+        if (!Profile.capturing()) {
+          Profile.startCapture();
+          std::cout << "Profiling..." << std::endl;
+        } else {
+          const std::string Path = "profile-" + std::to_string(Captures++) + ".json";
+          if (Profile.stopCapture(Path))
+            std::cout << "Wrote " << Path << std::endl;
+          else
+            std::cerr << "Couldn't write " << Path << std::endl;
+        }
+      }
+#endif
       controls.handleEvent(event);
       camera.handleEvent(event);
     }
     controls.update();
-    //camera.updatePos(controls.getX(), controls.getZ());
-
-    if (controls.jumpPoll())
-      if (Player.onGround())
-        Player.jump();
-    Player.setMove(camera.getHorizAngle(), controls.getX(), controls.getY(), controls.getZ());
-    for (float deltaTimeCopy = deltaTime - 1 / 30.0f; true; deltaTimeCopy -= 1 / 30.0f) {
-      if (deltaTimeCopy > 0)
-        Player.update(1 / 30.0f);
-      else {
-        Player.update(deltaTimeCopy + 1 / 30.0f);
-        break;
-      }
-    }
-    camera.setPos(Player.position().x, Player.position().y, Player.position().z);
-
-    Chunk.update(deltaTime);
-
-    // std::cout << "Current V( " << Player.position().toVoxelPos() << "): " << Chunk.get(Player.position().toVoxelPos()).getName() << std::endl;
 
     if (controls.getBlockType() < BlockTypes.size())
       SelectedType = BlockTypes[controls.getBlockType()];
 
-    if (false) {
-      auto cameraPos = camera.getPosition();
-      v3 cameraVoxel((int64_t) cameraPos.x, (int64_t) cameraPos.y,
-                     (int64_t) cameraPos.z);
-      if (CameraLight.setPos(cameraVoxel)) {
-        Renderer.recreateSurrounding(cameraVoxel);
-      }
-    }
-
-
-    if (controls.leftMousePoll()) {
-      for (int i = 0; i < 20; ++i) {
-        auto cameraPos = camera.getPosition() + camera.getDirection(i / 4.0f);
-
-        v3 cameraVoxel((int64_t) cameraPos.x, (int64_t) cameraPos.y,
-                       (int64_t) cameraPos.z);
-
-        if (!space.get(cameraVoxel).isBuildable())
-          continue;
+    PlayerInput Input;
+    Input.horizAngle = camera.getHorizAngle();
+    Input.x = controls.getX();
+    Input.y = controls.getY();
+    Input.z = controls.getZ();
+    Input.direction = camera.getDirection(1);
+    Input.blockType = SelectedType;
+    Input.jump = controls.jumpPoll();
+    Input.breakBlock = controls.leftMousePoll();
+    Input.placeBlock = controls.rightMousePoll();
+    Sim.setInput(Input);
 
-        space.getChunk(cameraVoxel)->setBlock(cameraVoxel, Voxel::AIR);
-
-        Renderer.recreateSurrounding(cameraVoxel);
-        Renderer2.recreateSurrounding(cameraVoxel);
-        break;
-      }
-    }
-
-    if (controls.rightMousePoll()) {
-      vec3 lastFreePos = camera.getPosition();
-      for (int i = 0; i < 20; ++i) {
-        auto testPos = camera.getPosition() + camera.getDirection(i / 4.0f);
-
-        v3 cameraVoxel((int64_t) testPos.x, (int64_t) testPos.y,
-                       (int64_t) testPos.z);
-
-        if (!space.get(cameraVoxel).isBuildable()) {
-          lastFreePos = testPos;
-          continue;
-        }
-
-        if (lastFreePos != camera.getPosition()) {
-          v3 lastFreeVoxel((int64_t) lastFreePos.x, (int64_t) lastFreePos.y,
-                         (int64_t) lastFreePos.z);
-          if (auto C = space.getChunk(lastFreeVoxel)) {
-            if (!Player.isCollidingWith(lastFreeVoxel)) {
-              C->setBlock(lastFreeVoxel, SelectedType);
-              Renderer.recreateSurrounding(lastFreeVoxel);
-              Renderer2.recreateSurrounding(lastFreeVoxel);
-            }
-          }
+    // std::cout << "Current V( " << Player.position().toVoxelPos() << "): " << Chunk.get(Player.position().toVoxelPos()).getName() << std::endl;
 
-        }
-        break;
-
-      }
-    }
 
   }
   while (run);
 
-  // Cleanup VBO and shader
-  glDeleteProgram(BlockProgramID);
-  glDeleteTextures(1, &TextureID);
-
-  glDeleteProgram(SpaceProgramID);
-  glDeleteTextures(1, &SpaceTextureID);
-
-  return 0;
+  Sim.stop();
+
+  std::cout << "Session: ";
+  Counter.printSummary(Counter.summarizeAll(), std::cout);
+  if (!FrameTimesPath.empty() && !Counter.writeCSV(FrameTimesPath))
+    std::cerr << "Couldn't write " << FrameTimesPath << std::endl;
+
+  if (!RecordPath.empty()) {
+    // Ticks that ran after the last frame still changed the world.
+    RecordedFrame Last = Recording.getFrames().empty() ? RecordedFrame()
+                                                       : Recording.getFrames().back();
+    Last.DeltaMillis = 0;
+    Last.Ticks = Sim.takeTickInputs();
+    if (!Last.Ticks.empty())
+      Recording.addFrame(std::move(Last));
+  }
+  return finishSession(TheWorld, Recording, RecordPath, Replay, ReplayPath) ? 0 : 1;
 }
 
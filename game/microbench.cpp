@@ -0,0 +1,259 @@
+// Microbenchmarks for the hot paths of the voxel engine: voxel lookups,
+// light spreading, single and bulk block edits, meshing, world generation,
+// movement and entity queries. Entity queries are also timed against
+// testing every entity, which the grid has to beat.
+//
+// Nothing is drawn and meshes are only built into CPU side buffers, so
+// this needs neither a display nor a GL context.
+//
+// Usage: termination_shock_microbench [--filter TEXT] [--json FILE]
+//          [--repetitions N] [--warmup N] [--batch-ms MS]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MicroBenchmark.h"
+#include "VoxelChunk.h"
+#include "VoxelEdit.h"
+#include "VoxelMapRenderer.h"
+#include "GeometryArena.h"
+#include "LightAtlas.h"
+#include "MovingEntity.h"
+#include "EntityGrid.h"
+#include "Map.h"
+
+namespace {
+
+// Number of positions the lookup benchmarks go through per call.
+const size_t Lookups = 4096;
+
+// Random positions in the box [Min, Max), the same on every run.
+std::vector<v3> randomPositions(v3 Min, v3 Max, unsigned Seed) {
+  std::mt19937 Engine(Seed);
+  std::uniform_int_distribution<int64_t> X(Min.x, Max.x - 1), Y(Min.y, Max.y - 1),
+    Z(Min.z, Max.z - 1);
+  std::vector<v3> Result;
+  for (size_t i = 0; i < Lookups; ++i)
+    Result.push_back(v3(X(Engine), Y(Engine), Z(Engine)));
+  return Result;
+}
+
+// Random points in the cube [0, Edge), the same on every run.
+std::vector<v3f> randomPoints(size_t Count, float Edge, unsigned Seed) {
+  std::mt19937 Engine(Seed);
+  std::uniform_real_distribution<float> Coordinate(0, Edge);
+  std::vector<v3f> Result;
+  for (size_t i = 0; i < Count; ++i)
+    Result.push_back(v3f(Coordinate(Engine), Coordinate(Engine), Coordinate(Engine)));
+  return Result;
+}
+
+// An entity of the default size standing still at the given position.
+struct PlacedEntity : Entity {
+  explicit PlacedEntity(const v3f &At) {
+    pos = At;
+  }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+  MicroBenchmark Bench;
+  std::string JsonPath;
+  for (int i = 1; i < argc; ++i) {
+    const bool HasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--filter") == 0 && HasValue)
+      Bench.setFilter(argv[++i]);
+    else if (std::strcmp(argv[i], "--json") == 0 && HasValue)
+      JsonPath = argv[++i];
+    else if (std::strcmp(argv[i], "--repetitions") == 0 && HasValue)
+      Bench.setRepetitions(std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--warmup") == 0 && HasValue)
+      Bench.setWarmup(std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--batch-ms") == 0 && HasValue)
+      Bench.setBatchMillis(std::atof(argv[++i]));
+    else {
+      std::cerr << "Unknown argument " << argv[i] << std::endl;
+      return 1;
+    }
+  }
+
+  // The same chunks as in the game.
+  VoxelChunk Ship({0, 0, 0});
+  Ship.generateSpaceShip();
+  VoxelChunk Meteor({160, 0, 0});
+  Meteor.generateMeteor();
+  Space TheSpace;
+  TheSpace.add(Ship);
+  TheSpace.add(Meteor);
+
+  const std::vector<v3> MeteorPositions = randomPositions({160, 0, 0}, {288, 128, 128}, 1);
+
+  Bench.run("VoxelChunk::get", Lookups, [&]() {
+    unsigned Sum = 0;
+    for (const v3 &Pos : MeteorPositions)
+      Sum += Meteor.get(Pos).getType();
+    MicroBenchmark::keep(Sum);
+  });
+
+  Bench.run("VoxelChunk::getAnnotated", Lookups, [&]() {
+    unsigned Sum = 0;
+    for (const v3 &Pos : MeteorPositions)
+      Sum += Meteor.getAnnotated(Pos).S[0].getType();
+    MicroBenchmark::keep(Sum);
+  });
+
+  // Moving the lamp onto itself takes its light away and spreads it again,
+  // which leaves the chunk as it was. The renderers would collect the
+  // changed light every frame.
+  const v3 Lamp(55, 15, 55);
+  Bench.run("VoxelChunk::spreadLight", 2, [&]() {
+    Ship.moveLight(Lamp, Lamp);
+    Ship.takeLightChanges();
+  });
+
+  // A copy of the ship room with a grid of lamps under the ceiling, which
+  // all have to be relit around every edit.
+  VoxelChunk LitShip({0, 0, 0});
+  LitShip.generateSpaceShip();
+  for (int64_t x = 52; x <= 58; x += 3)
+    for (int64_t z = 52; z <= 58; z += 3)
+      LitShip.setBlock({x, 18, z}, Voxel::LAMP);
+  const v3 Edited(54, 12, 56);
+  Bench.run("VoxelChunk::setBlock near 10 lights", 2, [&]() {
+    LitShip.setBlock(Edited, Voxel::CRATE);
+    LitShip.setBlock(Edited, Voxel::AIR);
+    LitShip.takeLightChanges();
+  });
+
+  // Carves a sphere with a diameter of 32 blocks and pastes back what was
+  // there, once in the meteor and once around the lamps of the ship.
+  const v3 Crater(224, 64, 64);
+  const v3 Radius(16, 16, 16);
+  VoxelEdit Carve, Restore;
+  Carve.fillSphere(Crater, 16, Voxel::AIR);
+  Restore.paste(Meteor.copy(Crater - Radius, Crater + Radius + v3(1, 1, 1)), Crater - Radius);
+  Bench.run("VoxelEdit sphere r16 meteor", 2, [&]() {
+    Meteor.apply(Carve);
+    Meteor.apply(Restore);
+  });
+  const v3 Room(55, 15, 55);
+  VoxelEdit CarveRoom, RestoreRoom;
+  CarveRoom.fillSphere(Room, 16, Voxel::AIR);
+  RestoreRoom.paste(LitShip.copy(Room - Radius, Room + Radius + v3(1, 1, 1)), Room - Radius);
+  Bench.run("VoxelEdit sphere r16 near 10 lights", 2, [&]() {
+    LitShip.apply(CarveRoom);
+    LitShip.apply(RestoreRoom);
+    LitShip.takeLightChanges();
+  });
+
+  // Meshes are built into CPU side buffers only.
+  GeometryArena Arena(true);
+  LightAtlas Lights(true);
+  VoxelMapRenderer ShipSection(Ship, {48, 0, 48}, Arena, Lights);
+  Bench.run("VoxelMapRenderer::recreate ship", 1, [&]() {
+    ShipSection.recreate();
+  });
+  VoxelMapRenderer MeteorSection(Meteor, {208, 48, 48}, Arena, Lights);
+  Bench.run("VoxelMapRenderer::recreate meteor", 1, [&]() {
+    MeteorSection.recreate();
+  });
+
+  Bench.run("VoxelChunk::generateMeteor", 1, [&]() {
+    VoxelChunk Generated({160, 0, 0});
+    Generated.generateMeteor();
+    MicroBenchmark::keep(Generated.get({224, 64, 64}));
+  });
+
+  // Most positions lie outside of both chunks, like most of space.
+  const std::vector<v3> SpacePositions = randomPositions({-64, -64, -64}, {320, 192, 192}, 2);
+  Bench.run("Space::getChunk", Lookups, [&]() {
+    size_t Found = 0;
+    for (const v3 &Pos : SpacePositions)
+      Found += TheSpace.getChunk(Pos) != nullptr;
+    MicroBenchmark::keep(Found);
+  });
+
+  // Walks around in the ship room, bumping into its walls.
+  MovingEntity Player(&TheSpace);
+  float Angle = 0;
+  Bench.run("MovingEntity::update", 1, [&]() {
+    Angle += 0.01f;
+    Player.setMove(Angle, 0, 0, 1);
+    Player.update(1 / 60.0f);
+  });
+
+  // Entities scattered through a cube with an edge of 64 blocks at a few
+  // densities, from one per 4096 blocks to one per 64 blocks.
+  const float EntityEdge = 64;
+  const std::vector<v3f> QueryCenters = randomPoints(64, EntityEdge, 3);
+  const v3f QueryExtent(4, 4, 4);
+  const float QueryRadius = 4;
+  for (size_t Count : {64, 512, 4096}) {
+    std::vector<PlacedEntity> Entities;
+    for (const v3f &At : randomPoints(Count, EntityEdge, 4))
+      Entities.emplace_back(At);
+    EntityGrid Grid;
+    for (PlacedEntity &E : Entities)
+      Grid.add(E);
+    const std::string Suffix = " " + std::to_string(Count) + " entities";
+    std::vector<Entity *> Found;
+
+    Bench.run("EntityGrid::queryBox" + Suffix, QueryCenters.size(), [&]() {
+      size_t Total = 0;
+      for (const v3f &Center : QueryCenters) {
+        Found.clear();
+        Grid.queryBox(Center - QueryExtent, Center + QueryExtent, Found);
+        Total += Found.size();
+      }
+      MicroBenchmark::keep(Total);
+    });
+    Bench.run("brute force queryBox" + Suffix, QueryCenters.size(), [&]() {
+      size_t Total = 0;
+      for (const v3f &Center : QueryCenters)
+        for (const PlacedEntity &E : Entities)
+          Total += E.overlaps(Center - QueryExtent, Center + QueryExtent);
+      MicroBenchmark::keep(Total);
+    });
+
+    Bench.run("EntityGrid::queryRadius" + Suffix, QueryCenters.size(), [&]() {
+      size_t Total = 0;
+      for (const v3f &Center : QueryCenters) {
+        Found.clear();
+        Grid.queryRadius(Center, QueryRadius, Found);
+        Total += Found.size();
+      }
+      MicroBenchmark::keep(Total);
+    });
+    Bench.run("brute force queryRadius" + Suffix, QueryCenters.size(), [&]() {
+      size_t Total = 0;
+      for (const v3f &Center : QueryCenters)
+        for (const PlacedEntity &E : Entities)
+          Total += E.distanceSquared(Center) <= QueryRadius * QueryRadius;
+      MicroBenchmark::keep(Total);
+    });
+
+    Bench.run("EntityGrid::forEachOverlappingPair" + Suffix, Count, [&]() {
+      size_t Pairs = 0;
+      Grid.forEachOverlappingPair([&](Entity &, Entity &) { ++Pairs; });
+      MicroBenchmark::keep(Pairs);
+    });
+    Bench.run("brute force overlapping pairs" + Suffix, Count, [&]() {
+      size_t Pairs = 0;
+      for (size_t i = 0; i < Entities.size(); ++i)
+        for (size_t j = i + 1; j < Entities.size(); ++j)
+          Pairs += Entities[i].overlaps(Entities[j].boundsMin(), Entities[j].boundsMax());
+      MicroBenchmark::keep(Pairs);
+    });
+  }
+
+  if (!JsonPath.empty() && !Bench.writeJSON(JsonPath)) {
+    std::cerr << "Couldn't write " << JsonPath << std::endl;
+    return 1;
+  }
+  return 0;
+}